@@ -171,7 +171,10 @@ class EncryptionService {
         
         // WebAssembly decryption
         const decrypted = this.crypto.decryptMessage(bytes, key);
-        
+        if (decrypted === null) {
+          throw new Error('Message failed authentication');
+        }
+
         console.log('🔓 Message decrypted');
         return decrypted;
       } else {
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Build native benchmark harnesses for the WebAssembly modules
+# Uses the host C++ compiler; Emscripten is not required
+
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+OUT_DIR=build
+BENCHMARKS="message_search_bench sync_engine_bench"
+
+echo "🔨 Building native benchmarks with $CXX..."
+
+if ! command -v "$CXX" &> /dev/null; then
+    echo "❌ Error: C++ compiler ($CXX) not found!"
+    echo "Set CXX to a C++17 compiler, e.g. CXX=clang++ ./build.sh"
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+for bench in $BENCHMARKS; do
+    "$CXX" "$bench.cpp" \
+        -o "$OUT_DIR/$bench" \
+        -O3 \
+        -DNDEBUG \
+        -std=c++17
+
+    if [ $? -ne 0 ]; then
+        echo "❌ Build failed: $bench"
+        exit 1
+    fi
+    echo "✅ $OUT_DIR/$bench"
+done
+
+echo "📊 Run e.g.: $OUT_DIR/message_search_bench --messages 1000000 --output results.json"
+echo "          $OUT_DIR/sync_engine_bench --sizes 10000,100000,1000000 --output sync.json"
@@ -0,0 +1,352 @@
+/**
+ * Native benchmark for the message search engine
+ * Builds a synthetic chat corpus and reports index build time, memory
+ * footprint and per-query latency percentiles as JSON.
+ *
+ * Corpus model:
+ * - Zipfian vocabulary of pronounceable synthetic words
+ * - Log-normal message lengths (most messages short, a long tail)
+ * - Zipfian sender distribution
+ * - Message embeddings are the normalised sum of per-word random vectors,
+ *   so messages sharing words are close; a query embeds its single word
+ *
+ * build covers indexMessage, which keeps the BM25 and spelling indexes
+ * current. SimHash signatures are computed on first use, so a timed
+ * warm-up (lazyIndexes) forces them before any query runs. Query inputs
+ * (including misspellings) are generated before timing, and the first
+ * query of each type is reported separately as firstMs.
+ *
+ * Usage: message_search_bench [--messages N] [--queries N] [--vocabulary N]
+ *                             [--senders N] [--dimensions N] [--seed N]
+ *                             [--max-seconds S] [--output file.json]
+ */
+
+#include "../message_search.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+
+struct Config {
+    int messages = 1000000;
+    int queries = 1000;
+    int vocabulary = 50000;
+    int senders = 2000;
+    int dimensions = 64;
+    unsigned seed = 42;
+    double maxSecondsPerType = 10.0;
+    std::string output;
+};
+
+struct LatencyStats {
+    int samples = 0;
+    double firstMs = 0.0;
+    double meanMs = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+    double avgResults = 0.0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Resident set size in bytes (Linux); 0 where unavailable
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize > 0 ? resident * static_cast<size_t>(pageSize) : 0;
+}
+
+/**
+ * Zipf(s = 1.0) sampler over ranks [0, n) using an inverse CDF table
+ */
+class ZipfSampler {
+public:
+    explicit ZipfSampler(int n) : cdf(n) {
+        double sum = 0.0;
+        for (int i = 0; i < n; i++) {
+            sum += 1.0 / (i + 1);
+            cdf[i] = sum;
+        }
+        for (auto& value : cdf) value /= sum;
+    }
+
+    int operator()(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+std::vector<std::string> makeVocabulary(int size, std::mt19937_64& rng) {
+    static const char* onsets[] = {"b", "c", "d", "f", "g", "h", "j", "k", "l", "m", "n", "p",
+                                   "r", "s", "t", "v", "w", "z", "ch", "sh", "th", "tr", "st", "br"};
+    static const char* vowels[] = {"a", "e", "i", "o", "u", "ai", "ea", "oo", "ou", "y"};
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> words;
+    words.reserve(size);
+
+    // Frequent ranks get short words, like natural language
+    while (static_cast<int>(words.size()) < size) {
+        int syllables = 1 + static_cast<int>(std::log10(words.size() + 10)) / 2 + static_cast<int>(rng() % 2);
+        std::string word;
+        for (int i = 0; i < syllables; i++) {
+            word += onsets[rng() % 24];
+            word += vowels[rng() % 10];
+        }
+        if (seen.insert(word).second) words.push_back(word);
+    }
+    return words;
+}
+
+std::string misspell(const std::string& word, std::mt19937_64& rng) {
+    if (word.size() < 3) return word + "x";
+    std::string result = word;
+    size_t pos = 1 + rng() % (word.size() - 2);
+    if (rng() % 2) result[pos] = static_cast<char>('a' + rng() % 26);
+    else std::swap(result[pos], result[pos - 1]);
+    return result;
+}
+
+void normalize(std::vector<float>& vector) {
+    float norm = 0.0f;
+    for (float value : vector) norm += value * value;
+    norm = std::sqrt(norm);
+    if (norm > 0.0f) {
+        for (auto& value : vector) value /= norm;
+    }
+}
+
+std::vector<float> randomUnitVector(int dimensions, std::mt19937_64& rng) {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> vector(dimensions);
+    for (auto& value : vector) value = normal(rng);
+    normalize(vector);
+    return vector;
+}
+
+// The first call absorbs one-off lazy index builds, so it is kept out of the percentiles
+LatencyStats measure(const Config& config, const std::function<std::vector<int>(int)>& query) {
+    std::vector<double> latencies;
+    double totalResults = 0.0;
+    Clock::time_point begin = Clock::now();
+
+    LatencyStats stats;
+    query(0);
+    stats.firstMs = elapsedMs(begin);
+
+    for (int i = 0; i < config.queries; i++) {
+        Clock::time_point start = Clock::now();
+        std::vector<int> results = query(i);
+        latencies.push_back(elapsedMs(start));
+        totalResults += results.size();
+        if (elapsedMs(begin) > config.maxSecondsPerType * 1000.0) break;
+    }
+
+    stats.samples = static_cast<int>(latencies.size());
+    if (latencies.empty()) return stats;
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double value : latencies) sum += value;
+    auto percentile = [&](double p) {
+        size_t index = static_cast<size_t>(std::ceil(p * latencies.size())) - 1;
+        return latencies[std::min(index, latencies.size() - 1)];
+    };
+
+    stats.meanMs = sum / latencies.size();
+    stats.p50Ms = percentile(0.50);
+    stats.p95Ms = percentile(0.95);
+    stats.p99Ms = percentile(0.99);
+    stats.maxMs = latencies.back();
+    stats.avgResults = totalResults / latencies.size();
+    return stats;
+}
+
+bool parseArgs(int argc, char** argv, Config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--messages") config.messages = std::atoi(value);
+        else if (arg == "--queries") config.queries = std::atoi(value);
+        else if (arg == "--vocabulary") config.vocabulary = std::atoi(value);
+        else if (arg == "--senders") config.senders = std::atoi(value);
+        else if (arg == "--dimensions") config.dimensions = std::atoi(value);
+        else if (arg == "--seed") config.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--max-seconds") config.maxSecondsPerType = std::atof(value);
+        else if (arg == "--output") config.output = value;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return config.messages > 0 && config.queries > 0 && config.vocabulary > 0 && config.senders > 0 &&
+           config.dimensions > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parseArgs(argc, argv, config)) return 1;
+
+    std::mt19937_64 rng(config.seed);
+    std::vector<std::string> vocabulary = makeVocabulary(config.vocabulary, rng);
+    ZipfSampler wordRank(config.vocabulary);
+    ZipfSampler senderRank(config.senders);
+    std::lognormal_distribution<double> messageLength(2.3, 0.8); // median ~10 words
+
+    std::vector<std::string> senders;
+    for (int i = 0; i < config.senders; i++) {
+        senders.push_back(vocabulary[(i * 7919) % config.vocabulary] + " " +
+                          vocabulary[(i * 104729 + 13) % config.vocabulary]);
+    }
+
+    // Generate up front so corpus construction is not timed as indexing
+    std::vector<std::string> texts(config.messages);
+    std::vector<int> messageSenders(config.messages);
+    for (int i = 0; i < config.messages; i++) {
+        int words = std::max(1, std::min(200, static_cast<int>(messageLength(rng))));
+        std::string& text = texts[i];
+        for (int w = 0; w < words; w++) {
+            if (w) text += ' ';
+            text += vocabulary[wordRank(rng)];
+        }
+        messageSenders[i] = senderRank(rng);
+    }
+
+    MessageSearchEngine engine;
+    size_t rssBefore = residentBytes();
+    Clock::time_point buildStart = Clock::now();
+    for (int i = 0; i < config.messages; i++) {
+        engine.indexMessage(i, texts[i], senders[messageSenders[i]], std::to_string(1700000000000LL + i * 1000LL));
+    }
+    double buildMs = elapsedMs(buildStart);
+    size_t rssAfter = residentBytes();
+
+    // Everything the engine builds on first use, so no query absorbs it
+    Clock::time_point lazyStart = Clock::now();
+    engine.findNearDuplicates(0);
+    double lazyMs = elapsedMs(lazyStart);
+    size_t rssLazy = residentBytes();
+
+    std::vector<std::vector<float>> wordVectors;
+    wordVectors.reserve(config.vocabulary);
+    for (int i = 0; i < config.vocabulary; i++) {
+        wordVectors.push_back(randomUnitVector(config.dimensions, rng));
+    }
+    std::unordered_map<std::string, int> wordIds;
+    for (int i = 0; i < config.vocabulary; i++) wordIds[vocabulary[i]] = i;
+
+    // Embedding a message is not timed; attaching and training the index is
+    double vectorMs = 0.0;
+    std::vector<float> embedding(config.dimensions);
+    for (int i = 0; i < config.messages; i++) {
+        std::fill(embedding.begin(), embedding.end(), 0.0f);
+        std::istringstream words(texts[i]);
+        std::string word;
+        while (words >> word) {
+            const std::vector<float>& wordVector = wordVectors[wordIds[word]];
+            for (int d = 0; d < config.dimensions; d++) embedding[d] += wordVector[d];
+        }
+        normalize(embedding);
+        Clock::time_point attachStart = Clock::now();
+        engine.setEmbedding(i, embedding);
+        vectorMs += elapsedMs(attachStart);
+    }
+    Clock::time_point trainStart = Clock::now();
+    engine.buildVectorIndex(0);
+    vectorMs += elapsedMs(trainStart);
+    size_t rssVectors = residentBytes();
+
+    // Query terms: half drawn by corpus frequency, half uniformly (rare words)
+    std::vector<std::string> queryWords;
+    std::vector<std::string> misspelledWords;
+    std::vector<std::string> querySenders;
+    std::vector<const std::vector<float>*> queryVectors;
+    for (int i = 0; i < config.queries; i++) {
+        int rank = (i % 2) ? wordRank(rng) : static_cast<int>(rng() % config.vocabulary);
+        queryWords.push_back(vocabulary[rank]);
+        misspelledWords.push_back(misspell(vocabulary[rank], rng));
+        querySenders.push_back(senders[senderRank(rng)].substr(0, 4));
+        queryVectors.push_back(&wordVectors[rank]);
+    }
+
+    std::vector<std::pair<std::string, LatencyStats>> results;
+    results.push_back({"search", measure(config, [&](int i) {
+        return engine.search(queryWords[i]);
+    })});
+    results.push_back({"fuzzySearch", measure(config, [&](int i) {
+        return engine.fuzzySearch(misspelledWords[i], 2);
+    })});
+    results.push_back({"patternSearch", measure(config, [&](int i) {
+        return engine.patternSearch("*" + queryWords[i].substr(0, 3) + "?" + "*");
+    })});
+    results.push_back({"searchBySender", measure(config, [&](int i) {
+        return engine.searchBySender(querySenders[i]);
+    })});
+    results.push_back({"multiFieldSearch", measure(config, [&](int i) {
+        return engine.multiFieldSearch(queryWords[i]);
+    })});
+    results.push_back({"semanticSearch", measure(config, [&](int i) {
+        return engine.semanticSearch(*queryVectors[i], 10);
+    })});
+    results.push_back({"hybridSearch", measure(config, [&](int i) {
+        return engine.hybridSearch(queryWords[i], *queryVectors[i], 10, 0.5f);
+    })});
+
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(4);
+    json << "{\n"
+         << "  \"benchmark\": \"message_search\",\n"
+         << "  \"formatVersion\": 3,\n"
+         << "  \"config\": {\"messages\": " << config.messages << ", \"queries\": " << config.queries
+         << ", \"vocabulary\": " << config.vocabulary << ", \"senders\": " << config.senders
+         << ", \"dimensions\": " << config.dimensions << ", \"seed\": " << config.seed << "},\n"
+         << "  \"build\": {\"ms\": " << buildMs
+         << ", \"messagesPerSecond\": " << (buildMs > 0 ? config.messages / (buildMs / 1000.0) : 0.0)
+         << ", \"rssBytes\": " << (rssAfter > rssBefore ? rssAfter - rssBefore : 0) << "},\n"
+         << "  \"lazyIndexes\": {\"ms\": " << lazyMs
+         << ", \"rssBytes\": " << (rssLazy > rssAfter ? rssLazy - rssAfter : 0) << "},\n"
+         << "  \"vectorIndex\": {\"ms\": " << vectorMs
+         << ", \"rssBytes\": " << (rssVectors > rssLazy ? rssVectors - rssLazy : 0) << "},\n"
+         << "  \"queries\": {\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const LatencyStats& stats = results[i].second;
+        json << "    \"" << results[i].first << "\": {\"samples\": " << stats.samples
+             << ", \"firstMs\": " << stats.firstMs << ", \"meanMs\": " << stats.meanMs
+             << ", \"p50Ms\": " << stats.p50Ms << ", \"p95Ms\": " << stats.p95Ms
+             << ", \"p99Ms\": " << stats.p99Ms << ", \"maxMs\": " << stats.maxMs
+             << ", \"avgResults\": " << stats.avgResults << "}"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "  }\n}\n";
+
+    if (config.output.empty()) {
+        std::fputs(json.str().c_str(), stdout);
+    } else {
+        std::ofstream(config.output) << json.str();
+    }
+    return 0;
+}
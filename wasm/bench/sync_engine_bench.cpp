@@ -0,0 +1,456 @@
+/**
+ * Native benchmark for the offline sync engine
+ * Builds pairs of replicas that start identical, lets the peer drift,
+ * then brings the initiator up to date with each sync strategy and
+ * reports time and bytes exchanged per phase as JSON.
+ *
+ * Drift model (per scenario, relative to the replica size):
+ * - Edits: small in-place changes to existing messages
+ * - Deletes: tombstoned messages
+ * - Burst appends: new messages arriving in a few bursts of consecutive IDs
+ *
+ * Phases:
+ * - fullSync: initial transfer of the whole change log to an empty peer
+ * - calculateDiff: load the peer's message set as the remote side and diff
+ * - deltas: encode and apply deltas for every modified message
+ * - changeLog: incremental changesSince() from the peer's last cursor
+ * - merkle: range reconciliation round trips, then changesFor() the diff
+ * - iblt: strata estimator + IBLT round trip, then changesFor() the diff
+ * - snapshot: serialize() / deserialize() of the drifted replica
+ *
+ * Usage: sync_engine_bench [--sizes N,N,...] [--edit-rate R] [--delete-rate R]
+ *                          [--append-rate R] [--bursts N] [--seed N]
+ *                          [--output file.json]
+ */
+
+#include "../sync_engine.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+struct Config {
+    std::vector<int> sizes = {10000, 100000, 1000000};
+    double editRate = 0.01;
+    double deleteRate = 0.001;
+    double appendRate = 0.01;
+    int bursts = 10;
+    unsigned seed = 42;
+    std::string output;
+};
+
+struct PhaseStats {
+    std::string name;
+    double ms = 0.0;
+    size_t bytesToPeer = 0;       // sent by the replica being updated
+    size_t bytesFromPeer = 0;
+    int roundTrips = 0;
+    size_t differences = 0;       // IDs found or applied
+    int converged = -1;           // -1 where the phase is not a full sync
+};
+
+struct ScenarioStats {
+    int messages = 0;
+    int edits = 0;
+    int deletes = 0;
+    int appends = 0;
+    double buildMs = 0.0;
+    std::vector<PhaseStats> phases;
+    std::string error;            // set when the scenario was aborted
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+constexpr long long BASE_TIME = 1700000000000LL;
+
+std::string asString(const std::vector<uint8_t>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+std::vector<std::string> makeVocabulary(int size, std::mt19937_64& rng) {
+    static const char* onsets[] = {"b", "c", "d", "f", "g", "h", "k", "l", "m", "n", "p", "r",
+                                   "s", "t", "v", "w", "ch", "sh", "th", "st"};
+    static const char* vowels[] = {"a", "e", "i", "o", "u", "ai", "ea", "oo"};
+    std::vector<std::string> words(size);
+    for (auto& word : words) {
+        int syllables = 1 + static_cast<int>(rng() % 3);
+        for (int i = 0; i < syllables; i++) {
+            word += onsets[rng() % 20];
+            word += vowels[rng() % 8];
+        }
+    }
+    return words;
+}
+
+class TextGenerator {
+public:
+    explicit TextGenerator(std::mt19937_64& rng) : rng(rng), vocabulary(makeVocabulary(4000, rng)) {}
+
+    std::string message() {
+        int words = std::max(1, std::min(200, static_cast<int>(length(rng))));
+        std::string text;
+        for (int w = 0; w < words; w++) {
+            if (w) text += ' ';
+            text += vocabulary[rng() % vocabulary.size()];
+        }
+        return text;
+    }
+
+    // Typical user edit: replace one word, sometimes append a few
+    std::string edit(const std::string& text) {
+        std::string result = text;
+        size_t pos = rng() % (result.size() + 1);
+        size_t end = result.find(' ', pos);
+        result.replace(pos, (end == std::string::npos ? result.size() : end) - pos,
+                       vocabulary[rng() % vocabulary.size()]);
+        if (rng() % 4 == 0) result += " " + message();
+        return result;
+    }
+
+private:
+    std::mt19937_64& rng;
+    std::vector<std::string> vocabulary;
+    std::lognormal_distribution<double> length{2.3, 0.8};
+};
+
+// loadBatch() layout: u32 count, (i32 id, i64 timestamp, u32 offset,
+// u32 length) records, content arena
+std::string packBatch(const std::map<int, std::pair<long long, std::string>>& messages) {
+    std::string header, arena;
+    auto put = [&](uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) header += static_cast<char>((value >> (8 * i)) & 0xFF);
+    };
+    put(messages.size(), 4);
+    for (const auto& entry : messages) {
+        put(static_cast<uint32_t>(entry.first), 4);
+        put(static_cast<uint64_t>(entry.second.first), 8);
+        put(arena.size(), 4);
+        put(entry.second.second.size(), 4);
+        arena += entry.second.second;
+    }
+    return header + arena;
+}
+
+// Null if the snapshot does not load
+std::unique_ptr<SyncEngine> restore(const std::string& snapshot) {
+    std::unique_ptr<SyncEngine> engine(new SyncEngine());
+    if (!engine->deserialize(snapshot)) return nullptr;
+    return engine;
+}
+
+/**
+ * Drive Merkle range reconciliation to completion against peer.
+ * Returns the number of round trips.
+ */
+int reconcile(SyncEngine& engine, SyncEngine& peer, std::vector<uint8_t> query, PhaseStats* phase) {
+    int rounds = 0;
+    while (!query.empty()) {
+        std::vector<uint8_t> reply = peer.answerRangeQuery(asString(query));
+        if (phase) {
+            phase->bytesToPeer += query.size();
+            phase->bytesFromPeer += reply.size();
+        }
+        query = engine.continueReconcile(asString(reply));
+        rounds++;
+    }
+    return rounds;
+}
+
+/**
+ * Fetch every ID the last reconciliation reported as added or modified.
+ * The ID list is charged at 4 bytes per ID.
+ */
+void fetchDifferences(SyncEngine& engine, SyncEngine& peer, PhaseStats& phase) {
+    std::vector<int> ids = engine.reconciledAdded();
+    ids.insert(ids.end(), engine.reconciledModified().begin(), engine.reconciledModified().end());
+    std::vector<uint8_t> changes = peer.changesFor(ids);
+    uint64_t cursor = 0;
+    bool fullResync = false;
+    engine.applyChanges(asString(changes), cursor, fullResync);
+    phase.bytesToPeer += ids.size() * 4;
+    phase.bytesFromPeer += changes.size();
+    phase.differences = ids.size() + engine.reconciledDeleted().size();
+    phase.roundTrips++;
+}
+
+// Untimed check: a fresh reconciliation finds nothing left to fetch
+bool converged(SyncEngine& engine, SyncEngine& peer) {
+    reconcile(engine, peer, engine.beginReconcile(), nullptr);
+    return engine.reconciledAdded().empty() && engine.reconciledModified().empty();
+}
+
+ScenarioStats runScenario(const Config& config, int size, std::mt19937_64& rng) {
+    ScenarioStats stats;
+    stats.messages = size;
+    TextGenerator text(rng);
+
+    // Peer state as plain data, for the remote-side load of calculateDiff
+    std::map<int, std::pair<long long, std::string>> peerMessages;
+    for (int i = 0; i < size; i++) {
+        peerMessages[i] = {BASE_TIME + i * 1000LL, text.message()};
+    }
+
+    SyncEngine local;
+    local.setNodeId(1);
+    std::string batch = packBatch(peerMessages);
+    Clock::time_point start = Clock::now();
+    local.loadBatch(SyncEngine::SIDE_LOCAL, batch);
+    stats.buildMs = elapsedMs(start);
+    std::string baseSnapshot = asString(local.serialize());
+
+    SyncEngine peer;
+    peer.setNodeId(2);
+    {
+        PhaseStats phase;
+        phase.name = "fullSync";
+        start = Clock::now();
+        std::vector<uint8_t> changes = local.changesSince(0);
+        uint64_t cursor = 0;
+        bool fullResync = false;
+        phase.differences = peer.applyChanges(asString(changes), cursor, fullResync);
+        phase.ms = elapsedMs(start);
+        phase.bytesFromPeer = changes.size();
+        phase.roundTrips = 1;
+        phase.converged = converged(peer, local);
+        stats.phases.push_back(phase);
+    }
+
+    // Drift on the peer: edits, deletes, then bursts of appends
+    const uint64_t peerCursor = peer.getCursor();
+    long long now = BASE_TIME + size * 1000LL;
+    std::vector<int> ids(size);
+    for (int i = 0; i < size; i++) ids[i] = i;
+    std::shuffle(ids.begin(), ids.end(), rng);
+    stats.edits = static_cast<int>(std::llround(size * config.editRate));
+    stats.deletes = static_cast<int>(std::llround(size * config.deleteRate));
+    stats.appends = static_cast<int>(std::llround(size * config.appendRate));
+    stats.edits = std::min(stats.edits, size);
+    stats.deletes = std::min(stats.deletes, size - stats.edits);
+
+    std::vector<int> deleted;
+    for (int i = 0; i < stats.edits; i++) {
+        auto& message = peerMessages[ids[i]];
+        message = {now += 1000, text.edit(message.second)};
+        peer.addLocalMessage(ids[i], message.second, message.first);
+    }
+    for (int i = stats.edits; i < stats.edits + stats.deletes; i++) {
+        peer.deleteLocalMessage(ids[i], now += 1000);
+        peerMessages.erase(ids[i]);
+        deleted.push_back(ids[i]);
+    }
+    int bursts = std::max(1, config.bursts);
+    for (int i = 0; i < stats.appends; i++) {
+        if (i % std::max(1, stats.appends / bursts) == 0) now += 60000;
+        peerMessages[size + i] = {now += 10, text.message()};
+        peer.addLocalMessage(size + i, peerMessages[size + i].second, peerMessages[size + i].first);
+    }
+
+    // Every phase below starts from a fresh copy of the base replica
+    std::unique_ptr<SyncEngine> replica;
+    auto restoreReplica = [&]() {
+        replica = restore(baseSnapshot);
+        if (!replica) stats.error = "base snapshot failed to deserialize";
+        return replica != nullptr;
+    };
+
+    if (!restoreReplica()) return stats;
+    {
+        PhaseStats phase;
+        phase.name = "calculateDiff";
+        std::string remote = packBatch(peerMessages);
+        start = Clock::now();
+        replica->loadBatch(SyncEngine::SIDE_REMOTE, remote);
+        for (int id : deleted) replica->addRemoteTombstone(id, now);
+        SyncEngine::DiffLists lists = replica->calculateDiff();
+        phase.ms = elapsedMs(start);
+        phase.bytesFromPeer = remote.size() + deleted.size() * 12;
+        phase.roundTrips = 1;
+        for (const auto& list : lists) phase.differences += list.size();
+        stats.phases.push_back(phase);
+    }
+    {
+        // Same replica: local is the base, remote the drifted peer set
+        PhaseStats phase;
+        phase.name = "deltas";
+        start = Clock::now();
+        std::vector<uint8_t> deltas = replica->generateAllDeltas();
+        std::vector<int> failed;
+        int applied = replica->applyDeltaBatch(asString(deltas), failed);
+        phase.ms = elapsedMs(start);
+        phase.bytesFromPeer = deltas.size();
+        phase.roundTrips = 1;
+        phase.differences = applied > 0 ? applied : 0;
+        stats.phases.push_back(phase);
+    }
+    replica.reset();
+
+    if (!restoreReplica()) return stats;
+    {
+        PhaseStats phase;
+        phase.name = "changeLog";
+        start = Clock::now();
+        std::vector<uint8_t> changes = peer.changesSince(peerCursor);
+        uint64_t cursor = 0;
+        bool fullResync = false;
+        int applied = replica->applyChanges(asString(changes), cursor, fullResync);
+        phase.ms = elapsedMs(start);
+        phase.bytesToPeer = 8;
+        phase.bytesFromPeer = changes.size();
+        phase.roundTrips = 1;
+        phase.differences = applied > 0 ? applied : 0;
+        phase.converged = converged(*replica, peer);
+        stats.phases.push_back(phase);
+    }
+
+    if (!restoreReplica()) return stats;
+    {
+        PhaseStats phase;
+        phase.name = "merkle";
+        start = Clock::now();
+        phase.roundTrips = reconcile(*replica, peer, replica->beginReconcile(), &phase);
+        fetchDifferences(*replica, peer, phase);
+        phase.ms = elapsedMs(start);
+        phase.converged = converged(*replica, peer);
+        stats.phases.push_back(phase);
+    }
+
+    if (!restoreReplica()) return stats;
+    {
+        PhaseStats phase;
+        phase.name = "iblt";
+        start = Clock::now();
+        std::vector<uint8_t> estimator = replica->encodeStrataEstimator();
+        std::vector<uint8_t> table = peer.encodeIBLTForPeer(asString(estimator));
+        phase.bytesToPeer = estimator.size();
+        phase.bytesFromPeer = table.size();
+        phase.roundTrips = 1;
+        // Undecodable tables fall back to Merkle reconciliation
+        phase.roundTrips += reconcile(*replica, peer, replica->decodePeerIBLT(asString(table)), &phase);
+        fetchDifferences(*replica, peer, phase);
+        phase.ms = elapsedMs(start);
+        phase.converged = converged(*replica, peer);
+        stats.phases.push_back(phase);
+    }
+    replica.reset();
+
+    {
+        PhaseStats phase;
+        phase.name = "snapshot";
+        start = Clock::now();
+        std::string snapshot = asString(peer.serialize());
+        SyncEngine restored;
+        bool ok = restored.deserialize(snapshot);
+        phase.ms = elapsedMs(start);
+        phase.bytesFromPeer = snapshot.size();
+        phase.converged = ok && converged(restored, peer);
+        stats.phases.push_back(phase);
+    }
+    return stats;
+}
+
+bool parseSizes(const char* value, std::vector<int>& sizes) {
+    sizes.clear();
+    std::stringstream list(value);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        int size = std::atoi(item.c_str());
+        if (size <= 0) return false;
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+bool parseArgs(int argc, char** argv, Config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--sizes") {
+            if (!parseSizes(value, config.sizes)) return false;
+        }
+        else if (arg == "--edit-rate") config.editRate = std::atof(value);
+        else if (arg == "--delete-rate") config.deleteRate = std::atof(value);
+        else if (arg == "--append-rate") config.appendRate = std::atof(value);
+        else if (arg == "--bursts") config.bursts = std::atoi(value);
+        else if (arg == "--seed") config.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--output") config.output = value;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return config.editRate >= 0 && config.deleteRate >= 0 && config.appendRate >= 0 && config.bursts > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parseArgs(argc, argv, config)) return 1;
+
+    std::mt19937_64 rng(config.seed);
+    std::vector<ScenarioStats> scenarios;
+    bool failed = false;
+    for (int size : config.sizes) {
+        scenarios.push_back(runScenario(config, size, rng));
+        if (!scenarios.back().error.empty()) {
+            std::fprintf(stderr, "Scenario with %d messages aborted: %s\n", size,
+                         scenarios.back().error.c_str());
+            failed = true;
+        }
+    }
+
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(4);
+    json << "{\n"
+         << "  \"benchmark\": \"sync_engine\",\n"
+         << "  \"formatVersion\": 1,\n"
+         << "  \"config\": {\"sizes\": [";
+    for (size_t i = 0; i < config.sizes.size(); i++) json << (i ? ", " : "") << config.sizes[i];
+    json << "], \"editRate\": " << config.editRate << ", \"deleteRate\": " << config.deleteRate
+         << ", \"appendRate\": " << config.appendRate << ", \"bursts\": " << config.bursts
+         << ", \"seed\": " << config.seed << "},\n"
+         << "  \"scenarios\": [\n";
+    for (size_t s = 0; s < scenarios.size(); s++) {
+        const ScenarioStats& scenario = scenarios[s];
+        json << "    {\"messages\": " << scenario.messages
+             << ", \"drift\": {\"edits\": " << scenario.edits << ", \"deletes\": " << scenario.deletes
+             << ", \"appends\": " << scenario.appends << "}"
+             << ", \"build\": {\"ms\": " << scenario.buildMs
+             << ", \"messagesPerSecond\": "
+             << (scenario.buildMs > 0 ? scenario.messages / (scenario.buildMs / 1000.0) : 0.0) << "},\n";
+        if (!scenario.error.empty()) json << "     \"error\": \"" << scenario.error << "\",\n";
+        json << "     \"phases\": {\n";
+        for (size_t i = 0; i < scenario.phases.size(); i++) {
+            const PhaseStats& phase = scenario.phases[i];
+            json << "       \"" << phase.name << "\": {\"ms\": " << phase.ms
+                 << ", \"bytesToPeer\": " << phase.bytesToPeer << ", \"bytesFromPeer\": " << phase.bytesFromPeer
+                 << ", \"roundTrips\": " << phase.roundTrips << ", \"differences\": " << phase.differences;
+            if (phase.converged >= 0) json << ", \"converged\": " << (phase.converged ? "true" : "false");
+            json << "}" << (i + 1 < scenario.phases.size() ? ",\n" : "\n");
+        }
+        json << "     }}" << (s + 1 < scenarios.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    if (config.output.empty()) {
+        std::fputs(json.str().c_str(), stdout);
+    } else {
+        std::ofstream(config.output) << json.str();
+    }
+    return failed ? 1 : 0;
+}
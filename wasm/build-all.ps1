@@ -34,6 +34,7 @@ emcc $($module.file) ``
     -s MAXIMUM_MEMORY=512MB ``
     -s EXPORTED_RUNTIME_METHODS='["cwrap","ccall"]' ``
     --bind ``
+    -msimd128 ``
     -O3 ``
     -std=c++17
 "@
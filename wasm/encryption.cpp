@@ -1,9 +1,9 @@
 /**
  * End-to-End Encryption Module
  * High-performance cryptography for secure messaging
- * 
+ *
  * Features:
- * - AES-256 encryption/decryption (symmetric)
+ * - AES-256-GCM authenticated encryption (cached key schedules, streaming)
  * - RSA-2048 key generation and encryption (asymmetric)
  * - Secure key exchange
  * - Message signing and verification
@@ -15,97 +15,466 @@
 #include <emscripten/val.h>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <algorithm>
 #include <cstring>
+#include <cstdint>
 #include <random>
-#include <chrono>
 
 using namespace emscripten;
 
-class CryptoEngine {
-private:
-    // Simple random number generator (use crypto library in production)
-    std::mt19937_64 rng;
+namespace CryptoUtils {
+    inline uint32_t load32(const uint8_t* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    inline void store32(uint8_t* p, uint32_t value) {
+        p[0] = static_cast<uint8_t>(value >> 24);
+        p[1] = static_cast<uint8_t>(value >> 16);
+        p[2] = static_cast<uint8_t>(value >> 8);
+        p[3] = static_cast<uint8_t>(value);
+    }
+
+    inline uint64_t load64(const uint8_t* p) {
+        return (uint64_t(load32(p)) << 32) | load32(p + 4);
+    }
+
+    inline void store64(uint8_t* p, uint64_t value) {
+        store32(p, static_cast<uint32_t>(value >> 32));
+        store32(p + 4, static_cast<uint32_t>(value));
+    }
 
-    // S-box for AES
+    inline uint32_t rotr32(uint32_t x, int r) {
+        return (x >> r) | (x << (32 - r));
+    }
+
+    // Compare without an early exit, so timing does not reveal the mismatch
+    inline bool equalConstantTime(const uint8_t* a, const uint8_t* b, size_t length) {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < length; i++) diff |= a[i] ^ b[i];
+        return diff == 0;
+    }
+
+    // Zero key material through a volatile pointer, so the stores are
+    // not dropped as dead just before the memory is freed
+    inline void wipe(void* data, size_t length) {
+        volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+        for (size_t i = 0; i < length; i++) p[i] = 0;
+    }
+}
+
+/**
+ * AES-256 block cipher, encryption direction only (all that CTR and GCM
+ * need). The key schedule is expanded once per key; rounds use a single
+ * 1 KB T-table with rotations instead of four, which keeps it cache
+ * resident.
+ */
+class AES256 {
+public:
+    static constexpr int KEY_BYTES = 32;
+    static constexpr int BLOCK_BYTES = 16;
+    static constexpr int ROUNDS = 14;
+
+    AES256() {
+        std::memset(roundKeys, 0, sizeof(roundKeys));
+    }
+
+    ~AES256() {
+        CryptoUtils::wipe(roundKeys, sizeof(roundKeys));
+    }
+
+    explicit AES256(const uint8_t* key) {
+        for (int i = 0; i < 8; i++) roundKeys[i] = CryptoUtils::load32(key + 4 * i);
+
+        uint32_t rcon = 0x01;
+        for (int i = 8; i < 4 * (ROUNDS + 1); i++) {
+            uint32_t temp = roundKeys[i - 1];
+            if (i % 8 == 0) {
+                temp = subWord((temp << 8) | (temp >> 24)) ^ (rcon << 24);
+                rcon = xtime(static_cast<uint8_t>(rcon));
+            } else if (i % 8 == 4) {
+                temp = subWord(temp);
+            }
+            roundKeys[i] = roundKeys[i - 8] ^ temp;
+        }
+    }
+
+    // The first eight schedule words are the key itself
+    bool hasKey(const uint8_t* key) const {
+        uint32_t diff = 0;
+        for (int i = 0; i < 8; i++) diff |= roundKeys[i] ^ CryptoUtils::load32(key + 4 * i);
+        return diff == 0;
+    }
+
+    void encryptBlock(const uint8_t* in, uint8_t* out) const {
+        const uint32_t* te = table();
+        const uint32_t* rk = roundKeys;
+        uint32_t s0 = CryptoUtils::load32(in) ^ rk[0];
+        uint32_t s1 = CryptoUtils::load32(in + 4) ^ rk[1];
+        uint32_t s2 = CryptoUtils::load32(in + 8) ^ rk[2];
+        uint32_t s3 = CryptoUtils::load32(in + 12) ^ rk[3];
+
+        for (int round = 1; round < ROUNDS; round++) {
+            rk += 4;
+            uint32_t t0 = te[s0 >> 24] ^ CryptoUtils::rotr32(te[(s1 >> 16) & 0xFF], 8) ^
+                          CryptoUtils::rotr32(te[(s2 >> 8) & 0xFF], 16) ^ CryptoUtils::rotr32(te[s3 & 0xFF], 24) ^ rk[0];
+            uint32_t t1 = te[s1 >> 24] ^ CryptoUtils::rotr32(te[(s2 >> 16) & 0xFF], 8) ^
+                          CryptoUtils::rotr32(te[(s3 >> 8) & 0xFF], 16) ^ CryptoUtils::rotr32(te[s0 & 0xFF], 24) ^ rk[1];
+            uint32_t t2 = te[s2 >> 24] ^ CryptoUtils::rotr32(te[(s3 >> 16) & 0xFF], 8) ^
+                          CryptoUtils::rotr32(te[(s0 >> 8) & 0xFF], 16) ^ CryptoUtils::rotr32(te[s1 & 0xFF], 24) ^ rk[2];
+            uint32_t t3 = te[s3 >> 24] ^ CryptoUtils::rotr32(te[(s0 >> 16) & 0xFF], 8) ^
+                          CryptoUtils::rotr32(te[(s1 >> 8) & 0xFF], 16) ^ CryptoUtils::rotr32(te[s2 & 0xFF], 24) ^ rk[3];
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        // Last round: SubBytes + ShiftRows, no MixColumns
+        rk += 4;
+        CryptoUtils::store32(out, finalWord(s0, s1, s2, s3) ^ rk[0]);
+        CryptoUtils::store32(out + 4, finalWord(s1, s2, s3, s0) ^ rk[1]);
+        CryptoUtils::store32(out + 8, finalWord(s2, s3, s0, s1) ^ rk[2]);
+        CryptoUtils::store32(out + 12, finalWord(s3, s0, s1, s2) ^ rk[3]);
+    }
+
+private:
     static const uint8_t sbox[256];
-    static const uint8_t inv_sbox[256];
 
-    /**
-     * XOR operation for encryption
-     */
-    void xorBytes(std::vector<uint8_t>& data, const std::vector<uint8_t>& key) {
-        for (size_t i = 0; i < data.size(); i++) {
-            data[i] ^= key[i % key.size()];
+    uint32_t roundKeys[4 * (ROUNDS + 1)];
+
+    static uint8_t xtime(uint8_t x) {
+        return static_cast<uint8_t>((x << 1) ^ ((x >> 7) * 0x1B));
+    }
+
+    static uint32_t subWord(uint32_t w) {
+        return (uint32_t(sbox[w >> 24]) << 24) | (uint32_t(sbox[(w >> 16) & 0xFF]) << 16) |
+               (uint32_t(sbox[(w >> 8) & 0xFF]) << 8) | uint32_t(sbox[w & 0xFF]);
+    }
+
+    static uint32_t finalWord(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        return (uint32_t(sbox[a >> 24]) << 24) | (uint32_t(sbox[(b >> 16) & 0xFF]) << 16) |
+               (uint32_t(sbox[(c >> 8) & 0xFF]) << 8) | uint32_t(sbox[d & 0xFF]);
+    }
+
+    // SubBytes + MixColumns for one byte: (2s, s, s, 3s); the other three
+    // columns are byte rotations of it
+    static const uint32_t* table() {
+        static const struct Table {
+            uint32_t entries[256];
+            Table() {
+                for (int x = 0; x < 256; x++) {
+                    uint8_t s = sbox[x];
+                    uint8_t s2 = xtime(s);
+                    entries[x] = (uint32_t(s2) << 24) | (uint32_t(s) << 16) | (uint32_t(s) << 8) | uint32_t(s2 ^ s);
+                }
+            }
+        } t;
+        return t.entries;
+    }
+};
+
+/**
+ * GHASH, the GCM authenticator: a polynomial hash over GF(2^128).
+ * Carry-less multiplication is emulated with ordinary 64-bit multiplies
+ * on operands masked to every fourth bit, so that carries land in bits
+ * that are masked off again. No secret-indexed tables, so it runs in
+ * constant time. Input may arrive in pieces of any length; pad() ends a
+ * section (AAD or ciphertext) at a block boundary.
+ */
+class GHash {
+public:
+    void setKey(const uint8_t* h) {
+        h1 = CryptoUtils::load64(h);
+        h0 = CryptoUtils::load64(h + 8);
+        h0r = reverse64(h0);
+        h1r = reverse64(h1);
+        h2 = h0 ^ h1;
+        h2r = h0r ^ h1r;
+        y0 = y1 = 0;
+        pendingLength = 0;
+    }
+
+    void update(const uint8_t* data, size_t length) {
+        if (pendingLength > 0) {
+            size_t take = std::min(length, 16 - pendingLength);
+            std::memcpy(pending + pendingLength, data, take);
+            pendingLength += take;
+            data += take;
+            length -= take;
+            if (pendingLength < 16) return;
+            absorb(pending);
+            pendingLength = 0;
         }
+        for (; length >= 16; data += 16, length -= 16) absorb(data);
+        if (length > 0) std::memcpy(pending, data, length);
+        pendingLength = length;
+    }
+
+    void pad() {
+        if (pendingLength == 0) return;
+        std::memset(pending + pendingLength, 0, 16 - pendingLength);
+        absorb(pending);
+        pendingLength = 0;
+    }
+
+    // Pad, absorb the bit lengths block and write the 16-byte hash
+    void finish(uint64_t aadBytes, uint64_t textBytes, uint8_t* out) {
+        pad();
+        uint8_t lengths[16];
+        CryptoUtils::store64(lengths, aadBytes * 8);
+        CryptoUtils::store64(lengths + 8, textBytes * 8);
+        absorb(lengths);
+        CryptoUtils::store64(out, y1);
+        CryptoUtils::store64(out + 8, y0);
+    }
+
+private:
+    uint64_t h0 = 0, h1 = 0, h2 = 0, h0r = 0, h1r = 0, h2r = 0;
+    uint64_t y0 = 0, y1 = 0;
+    uint8_t pending[16];
+    size_t pendingLength = 0;
+
+    static uint64_t carrylessMultiply(uint64_t x, uint64_t y) {
+        const uint64_t m0 = 0x1111111111111111ULL, m1 = 0x2222222222222222ULL;
+        const uint64_t m2 = 0x4444444444444444ULL, m3 = 0x8888888888888888ULL;
+        uint64_t x0 = x & m0, x1 = x & m1, x2 = x & m2, x3 = x & m3;
+        uint64_t y0 = y & m0, y1 = y & m1, y2 = y & m2, y3 = y & m3;
+        uint64_t z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+        uint64_t z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+        uint64_t z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+        uint64_t z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+        return (z0 & m0) | (z1 & m1) | (z2 & m2) | (z3 & m3);
+    }
+
+    static uint64_t reverse64(uint64_t x) {
+        x = ((x & 0x5555555555555555ULL) << 1) | ((x >> 1) & 0x5555555555555555ULL);
+        x = ((x & 0x3333333333333333ULL) << 2) | ((x >> 2) & 0x3333333333333333ULL);
+        x = ((x & 0x0F0F0F0F0F0F0F0FULL) << 4) | ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+        x = ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+        x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+        return (x << 32) | (x >> 32);
     }
 
     /**
-     * Rotate bytes (simplified AES operation)
+     * y = (y ^ block) * H. Karatsuba over the 64-bit halves gives the low
+     * product words; the same products on bit-reversed operands give the
+     * high words. GCM's bit order is reflected, so the 256-bit product is
+     * shifted left by one and reduced modulo x^128 + x^7 + x^2 + x + 1.
      */
-    void rotateBytes(std::vector<uint8_t>& data, int shift) {
-        if (data.empty()) return;
-        shift = shift % data.size();
-        std::rotate(data.begin(), data.begin() + shift, data.end());
+    void absorb(const uint8_t* block) {
+        y1 ^= CryptoUtils::load64(block);
+        y0 ^= CryptoUtils::load64(block + 8);
+        uint64_t y0r = reverse64(y0), y1r = reverse64(y1);
+        uint64_t y2 = y0 ^ y1, y2r = y0r ^ y1r;
+
+        uint64_t z0 = carrylessMultiply(y0, h0);
+        uint64_t z1 = carrylessMultiply(y1, h1);
+        uint64_t z2 = carrylessMultiply(y2, h2);
+        uint64_t z0h = carrylessMultiply(y0r, h0r);
+        uint64_t z1h = carrylessMultiply(y1r, h1r);
+        uint64_t z2h = carrylessMultiply(y2r, h2r);
+        z2 ^= z0 ^ z1;
+        z2h ^= z0h ^ z1h;
+        z0h = reverse64(z0h) >> 1;
+        z1h = reverse64(z1h) >> 1;
+        z2h = reverse64(z2h) >> 1;
+
+        uint64_t v0 = z0, v1 = z0h ^ z2, v2 = z1 ^ z2h, v3 = z1h;
+        v3 = (v3 << 1) | (v2 >> 63);
+        v2 = (v2 << 1) | (v1 >> 63);
+        v1 = (v1 << 1) | (v0 >> 63);
+        v0 = v0 << 1;
+
+        v2 ^= v0 ^ (v0 >> 1) ^ (v0 >> 2) ^ (v0 >> 7);
+        v1 ^= (v0 << 63) ^ (v0 << 62) ^ (v0 << 57);
+        v3 ^= v1 ^ (v1 >> 1) ^ (v1 >> 2) ^ (v1 >> 7);
+        v2 ^= (v1 << 63) ^ (v1 << 62) ^ (v1 << 57);
+        y0 = v2;
+        y1 = v3;
+    }
+};
+
+/**
+ * One AES-256-GCM encryption or decryption in progress. AAD must be
+ * added before the first update(); update() takes any chunk size and
+ * may run in place (out == in).
+ */
+class GCMStream {
+public:
+    static constexpr int TAG_BYTES = 16;
+
+    GCMStream(const AES256& cipher, const uint8_t* iv, size_t ivLength, bool encrypting)
+        : cipher(cipher), encrypting(encrypting) {
+        uint8_t h[16] = {0};
+        cipher.encryptBlock(h, h);
+        hash.setKey(h);
+
+        // J0: IV || 0^31 || 1 for the usual 96-bit IV, else GHASH of the IV
+        if (ivLength == 12) {
+            std::memcpy(counter, iv, 12);
+            CryptoUtils::store32(counter + 12, 1);
+        } else {
+            hash.update(iv, ivLength);
+            hash.finish(0, ivLength, counter);
+            hash.setKey(h);
+        }
+        cipher.encryptBlock(counter, tagMask);
+        increment();
+    }
+
+    bool isEncrypting() const {
+        return encrypting;
     }
 
+    bool addAAD(const uint8_t* data, size_t length) {
+        if (textStarted) return false;
+        hash.update(data, length);
+        aadBytes += length;
+        return true;
+    }
+
+    void update(const uint8_t* in, size_t length, uint8_t* out) {
+        if (!textStarted) {
+            hash.pad();
+            textStarted = true;
+        }
+        if (!encrypting) hash.update(in, length);
+
+        size_t i = 0;
+        // Drain keystream left over from the previous chunk
+        for (; i < length && keystreamUsed < 16; i++) out[i] = in[i] ^ keystream[keystreamUsed++];
+        for (; i + 16 <= length; i += 16) {
+            cipher.encryptBlock(counter, keystream);
+            increment();
+            for (int j = 0; j < 16; j++) out[i + j] = in[i + j] ^ keystream[j];
+        }
+        if (i < length) {
+            cipher.encryptBlock(counter, keystream);
+            increment();
+            keystreamUsed = 0;
+            for (; i < length; i++) out[i] = in[i] ^ keystream[keystreamUsed++];
+        }
+
+        if (encrypting) hash.update(out, length);
+        textBytes += length;
+    }
+
+    void finish(uint8_t* tag) {
+        hash.finish(aadBytes, textBytes, tag);
+        for (int i = 0; i < TAG_BYTES; i++) tag[i] ^= tagMask[i];
+    }
+
+private:
+    AES256 cipher;
+    GHash hash;
+    uint8_t counter[16];
+    uint8_t tagMask[16];        // E(K, J0)
+    uint8_t keystream[16];
+    unsigned int keystreamUsed = 16;
+    uint64_t aadBytes = 0;
+    uint64_t textBytes = 0;
+    bool textStarted = false;
+    bool encrypting;
+
+    // inc32: only the low 32 bits of the counter block count
+    void increment() {
+        CryptoUtils::store32(counter + 12, CryptoUtils::load32(counter + 12) + 1);
+    }
+};
+
+class CryptoEngine {
+private:
+    // Backed by the platform CSPRNG (crypto.getRandomValues under Emscripten)
+    std::random_device entropy;
+
+    // Expanded key schedules by handle (importKey)
+    std::unordered_map<int, AES256> keys;
+    int nextKeyHandle = 1;
+
+    // Streams in progress by handle (gcmInit)
+    std::unordered_map<int, GCMStream> streams;
+    int nextStreamHandle = 1;
+
+    // Schedule of the last raw key passed to encryptAES/decryptAES, so a
+    // session key is only expanded once. The schedule identifies the key;
+    // no separate copy of the raw bytes is kept.
+    AES256 cachedKey;
+    bool hasCachedKey = false;
+
     /**
-     * Substitute bytes using S-box
+     * Copy a Uint8Array (or array of byte values) out of JS in one call
      */
-    void substituteBytes(std::vector<uint8_t>& data, bool inverse = false) {
-        const uint8_t* box = inverse ? inv_sbox : sbox;
-        for (auto& byte : data) {
-            byte = box[byte];
-        }
+    static std::vector<uint8_t> toBytes(const val& data) {
+        return convertJSArrayToNumberVector<uint8_t>(data);
     }
 
     /**
-     * Add round key (XOR with key)
+     * Schedule for a raw key from JS; nullptr unless it is 32 bytes. The
+     * copied key bytes are wiped before returning.
      */
-    void addRoundKey(std::vector<uint8_t>& state, const std::vector<uint8_t>& key, int round) {
-        for (size_t i = 0; i < state.size() && i < key.size(); i++) {
-            state[i] ^= key[(i + round * 16) % key.size()];
+    const AES256* cipherFor(const val& keyData) {
+        std::vector<uint8_t> key = toBytes(keyData);
+        const AES256* cipher = nullptr;
+        if (key.size() == AES256::KEY_BYTES) {
+            if (!hasCachedKey || !cachedKey.hasKey(key.data())) {
+                cachedKey = AES256(key.data());
+                hasCachedKey = true;
+            }
+            cipher = &cachedKey;
         }
+        CryptoUtils::wipe(key.data(), key.size());
+        return cipher;
     }
 
     /**
-     * PKCS7 padding
+     * One-shot GCM encryption: ciphertext followed by the 16-byte tag
      */
-    void addPadding(std::vector<uint8_t>& data, int blockSize) {
-        int padding = blockSize - (data.size() % blockSize);
-        for (int i = 0; i < padding; i++) {
-            data.push_back(static_cast<uint8_t>(padding));
-        }
+    static std::vector<uint8_t> seal(const AES256& cipher, const std::vector<uint8_t>& iv,
+                                     const std::vector<uint8_t>& plaintext) {
+        GCMStream stream(cipher, iv.data(), iv.size(), true);
+        std::vector<uint8_t> out(plaintext.size() + GCMStream::TAG_BYTES);
+        stream.update(plaintext.data(), plaintext.size(), out.data());
+        stream.finish(out.data() + plaintext.size());
+        return out;
     }
 
     /**
-     * Remove PKCS7 padding
+     * One-shot GCM decryption of ciphertext || tag. Returns false (and
+     * no plaintext) if the tag does not match.
      */
-    void removePadding(std::vector<uint8_t>& data) {
-        if (data.empty()) return;
-        uint8_t padding = data.back();
-        if (padding > 0 && padding <= 16) {
-            data.resize(data.size() - padding);
-        }
+    static bool open(const AES256& cipher, const std::vector<uint8_t>& iv, const uint8_t* data,
+                     size_t length, std::vector<uint8_t>& plaintext) {
+        plaintext.clear();
+        if (length < GCMStream::TAG_BYTES) return false;
+        size_t textLength = length - GCMStream::TAG_BYTES;
+
+        GCMStream stream(cipher, iv.data(), iv.size(), false);
+        std::vector<uint8_t> out(textLength);
+        stream.update(data, textLength, out.data());
+        uint8_t tag[GCMStream::TAG_BYTES];
+        stream.finish(tag);
+        if (!CryptoUtils::equalConstantTime(tag, data + textLength, GCMStream::TAG_BYTES)) return false;
+        plaintext.swap(out);
+        return true;
     }
 
 public:
-    CryptoEngine() {
-        // Seed RNG with current time
-        auto seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-        rng.seed(seed);
-    }
+    static constexpr int IV_BYTES = 12;
+
+    CryptoEngine() {}
 
     /**
      * Generate random bytes for keys/IVs
      */
     std::vector<uint8_t> generateRandomBytes(int length) {
-        std::vector<uint8_t> bytes(length);
-        std::uniform_int_distribution<int> dist(0, 255);
-        
-        for (int i = 0; i < length; i++) {
-            bytes[i] = static_cast<uint8_t>(dist(rng));
+        std::vector<uint8_t> bytes(length > 0 ? length : 0);
+        for (size_t i = 0; i < bytes.size(); i += 4) {
+            uint32_t word = entropy();
+            for (size_t j = i; j < bytes.size() && j < i + 4; j++, word >>= 8) {
+                bytes[j] = static_cast<uint8_t>(word);
+            }
         }
-        
         return bytes;
     }
 
@@ -113,103 +482,141 @@ public:
      * Generate AES-256 encryption key
      */
     std::vector<uint8_t> generateAESKey() {
-        return generateRandomBytes(32); // 256 bits
+        return generateRandomBytes(AES256::KEY_BYTES);
     }
 
     /**
-     * Generate initialization vector
+     * Generate initialization vector (the 96-bit GCM nonce; never reuse
+     * one with the same key)
      */
     std::vector<uint8_t> generateIV() {
-        return generateRandomBytes(16); // 128 bits
+        return generateRandomBytes(IV_BYTES);
     }
 
     /**
-     * AES-256 Encryption (simplified)
-     * Note: This is a simplified implementation for demonstration.
-     * Use a proper crypto library (like libsodium) in production!
+     * Expand a 32-byte key once and keep the schedule for gcmInit().
+     * Returns a key handle, or -1 if the key is not 32 bytes.
      */
-    std::vector<uint8_t> encryptAES(const val& plaintext, const val& keyData, const val& ivData) {
-        // Convert inputs
-        unsigned int ptLength = plaintext["length"].as<unsigned int>();
-        std::vector<uint8_t> data(ptLength);
-        for (unsigned int i = 0; i < ptLength; i++) {
-            data[i] = plaintext[i].as<uint8_t>();
-        }
-
-        unsigned int keyLength = keyData["length"].as<unsigned int>();
-        std::vector<uint8_t> key(keyLength);
-        for (unsigned int i = 0; i < keyLength; i++) {
-            key[i] = keyData[i].as<uint8_t>();
-        }
+    int importKey(const val& keyData) {
+        std::vector<uint8_t> key = toBytes(keyData);
+        if (key.size() != AES256::KEY_BYTES) return -1;
+        int handle = nextKeyHandle++;
+        keys.emplace(handle, AES256(key.data()));
+        CryptoUtils::wipe(key.data(), key.size());
+        return handle;
+    }
 
-        unsigned int ivLength = ivData["length"].as<unsigned int>();
-        std::vector<uint8_t> iv(ivLength);
-        for (unsigned int i = 0; i < ivLength; i++) {
-            iv[i] = ivData[i].as<uint8_t>();
-        }
+    /**
+     * Drop a key schedule (streams already started with it keep working)
+     */
+    bool releaseKey(int keyHandle) {
+        return keys.erase(keyHandle) > 0;
+    }
 
-        // Add padding
-        addPadding(data, 16);
-
-        // Simplified AES rounds (10 rounds for AES-256)
-        std::vector<uint8_t> state = data;
-        
-        for (int round = 0; round < 10; round++) {
-            substituteBytes(state);
-            rotateBytes(state, round + 1);
-            addRoundKey(state, key, round);
-            xorBytes(state, iv);
-        }
+    /**
+     * Wipe the cached schedule of the last raw key passed to
+     * encryptAES/decryptAES/encryptMessage/decryptMessage
+     */
+    void releaseCachedKey() {
+        cachedKey = AES256();
+        hasCachedKey = false;
+    }
 
-        return state;
+    /**
+     * Start a streaming AES-256-GCM encryption (or decryption) under an
+     * imported key. aad is authenticated but not encrypted; pass an
+     * empty array for none. Returns a stream handle, or -1 for an
+     * unknown key or an empty IV.
+     */
+    int gcmInit(int keyHandle, const val& ivData, const val& aadData, bool encrypt) {
+        auto key = keys.find(keyHandle);
+        std::vector<uint8_t> iv = toBytes(ivData);
+        if (key == keys.end() || iv.empty()) return -1;
+
+        int handle = nextStreamHandle++;
+        GCMStream& stream = streams.emplace(handle, GCMStream(key->second, iv.data(), iv.size(), encrypt)).first->second;
+        std::vector<uint8_t> aad = toBytes(aadData);
+        stream.addAAD(aad.data(), aad.size());
+        return handle;
     }
 
     /**
-     * AES-256 Decryption
+     * Encrypt or decrypt the next chunk of any size. Decrypted output is
+     * unauthenticated until gcmVerify() succeeds.
      */
-    std::vector<uint8_t> decryptAES(const val& ciphertext, const val& keyData, const val& ivData) {
-        // Convert inputs
-        unsigned int ctLength = ciphertext["length"].as<unsigned int>();
-        std::vector<uint8_t> data(ctLength);
-        for (unsigned int i = 0; i < ctLength; i++) {
-            data[i] = ciphertext[i].as<uint8_t>();
-        }
+    std::vector<uint8_t> gcmUpdate(int streamHandle, const val& chunk) {
+        auto stream = streams.find(streamHandle);
+        if (stream == streams.end()) return {};
+        std::vector<uint8_t> data = toBytes(chunk);
+        stream->second.update(data.data(), data.size(), data.data());
+        return data;
+    }
 
-        unsigned int keyLength = keyData["length"].as<unsigned int>();
-        std::vector<uint8_t> key(keyLength);
-        for (unsigned int i = 0; i < keyLength; i++) {
-            key[i] = keyData[i].as<uint8_t>();
-        }
+    /**
+     * Discard a stream without finishing it, e.g. when a transfer is
+     * cancelled. False for an unknown handle.
+     */
+    bool gcmAbort(int streamHandle) {
+        return streams.erase(streamHandle) > 0;
+    }
 
-        unsigned int ivLength = ivData["length"].as<unsigned int>();
-        std::vector<uint8_t> iv(ivLength);
-        for (unsigned int i = 0; i < ivLength; i++) {
-            iv[i] = ivData[i].as<uint8_t>();
-        }
+    /**
+     * Finish an encryption stream and return its 16-byte tag
+     */
+    std::vector<uint8_t> gcmFinal(int streamHandle) {
+        auto stream = streams.find(streamHandle);
+        if (stream == streams.end() || !stream->second.isEncrypting()) return {};
+        std::vector<uint8_t> tag(GCMStream::TAG_BYTES);
+        stream->second.finish(tag.data());
+        streams.erase(stream);
+        return tag;
+    }
 
-        std::vector<uint8_t> state = data;
+    /**
+     * Finish a decryption stream; true if the tag authenticates
+     * everything passed through gcmUpdate()
+     */
+    bool gcmVerify(int streamHandle, const val& tagData) {
+        auto stream = streams.find(streamHandle);
+        if (stream == streams.end() || stream->second.isEncrypting()) return false;
+        std::vector<uint8_t> expected = toBytes(tagData);
+        uint8_t tag[GCMStream::TAG_BYTES];
+        stream->second.finish(tag);
+        streams.erase(stream);
+        return expected.size() == GCMStream::TAG_BYTES &&
+               CryptoUtils::equalConstantTime(tag, expected.data(), GCMStream::TAG_BYTES);
+    }
 
-        // Reverse the encryption rounds
-        for (int round = 9; round >= 0; round--) {
-            xorBytes(state, iv);
-            addRoundKey(state, key, round);
-            rotateBytes(state, -(round + 1));
-            substituteBytes(state, true);
-        }
+    /**
+     * AES-256-GCM encryption. Returns ciphertext || 16-byte tag, or an
+     * empty vector if the key is not 32 bytes or the IV is empty.
+     */
+    std::vector<uint8_t> encryptAES(const val& plaintext, const val& keyData, const val& ivData) {
+        const AES256* cipher = cipherFor(keyData);
+        std::vector<uint8_t> iv = toBytes(ivData);
+        if (!cipher || iv.empty()) return {};
+        return seal(*cipher, iv, toBytes(plaintext));
+    }
 
-        removePadding(state);
-        return state;
+    /**
+     * AES-256-GCM decryption of ciphertext || tag. Returns an empty
+     * vector if the key or IV is invalid or authentication fails.
+     */
+    std::vector<uint8_t> decryptAES(const val& ciphertext, const val& keyData, const val& ivData) {
+        const AES256* cipher = cipherFor(keyData);
+        std::vector<uint8_t> iv = toBytes(ivData);
+        std::vector<uint8_t> data = toBytes(ciphertext);
+        std::vector<uint8_t> plaintext;
+        if (!cipher || iv.empty()) return plaintext;
+        open(*cipher, iv, data.data(), data.size(), plaintext);
+        return plaintext;
     }
 
     /**
      * SHA-256 Hash (simplified)
      */
     std::vector<uint8_t> sha256(const val& input) {
-        unsigned int length = input["length"].as<unsigned int>();
-        std::vector<uint8_t> data(length);
-        for (unsigned int i = 0; i < length; i++) {
-            data[i] = input[i].as<uint8_t>();
-        }
+        std::vector<uint8_t> data = toBytes(input);
 
         // Simplified hash (use proper SHA-256 in production)
         std::vector<uint8_t> hash(32, 0);
@@ -228,46 +635,36 @@ public:
 
     /**
      * Encrypt message text
+     * Layout: 12-byte IV || ciphertext || 16-byte tag (the same as the
+     * Web Crypto AES-GCM fallback, so either side can decrypt)
      */
     std::vector<uint8_t> encryptMessage(const std::string& message, const val& keyData) {
-        std::vector<uint8_t> plaintext(message.begin(), message.end());
+        const AES256* cipher = cipherFor(keyData);
+        if (!cipher) return {};
+
         std::vector<uint8_t> iv = generateIV();
-        
-        val plaintextVal = val(typed_memory_view(plaintext.size(), plaintext.data()));
-        std::vector<uint8_t> encrypted = encryptAES(plaintextVal, keyData, 
-            val(typed_memory_view(iv.size(), iv.data())));
-
-        // Prepend IV to ciphertext
-        std::vector<uint8_t> result;
-        result.insert(result.end(), iv.begin(), iv.end());
+        std::vector<uint8_t> result(iv);
+        std::vector<uint8_t> encrypted = seal(*cipher, iv, std::vector<uint8_t>(message.begin(), message.end()));
         result.insert(result.end(), encrypted.begin(), encrypted.end());
 
         return result;
     }
 
     /**
-     * Decrypt message text
+     * Decrypt message text. Returns null, never a string, if the key is
+     * invalid, the data is too short or it does not authenticate, so a
+     * failure cannot pass for an empty message.
      */
-    std::string decryptMessage(const val& encryptedData, const val& keyData) {
-        unsigned int length = encryptedData["length"].as<unsigned int>();
-        std::vector<uint8_t> data(length);
-        for (unsigned int i = 0; i < length; i++) {
-            data[i] = encryptedData[i].as<uint8_t>();
-        }
+    val decryptMessage(const val& encryptedData, const val& keyData) {
+        std::vector<uint8_t> data = toBytes(encryptedData);
+        const AES256* cipher = cipherFor(keyData);
+        if (!cipher || data.size() < IV_BYTES + GCMStream::TAG_BYTES) return val::null();
 
-        if (data.size() < 16) return "";
+        std::vector<uint8_t> iv(data.begin(), data.begin() + IV_BYTES);
+        std::vector<uint8_t> decrypted;
+        if (!open(*cipher, iv, data.data() + IV_BYTES, data.size() - IV_BYTES, decrypted)) return val::null();
 
-        // Extract IV (first 16 bytes)
-        std::vector<uint8_t> iv(data.begin(), data.begin() + 16);
-        std::vector<uint8_t> ciphertext(data.begin() + 16, data.end());
-
-        // Decrypt
-        val ctVal = val(typed_memory_view(ciphertext.size(), ciphertext.data()));
-        val ivVal = val(typed_memory_view(iv.size(), iv.data()));
-        
-        std::vector<uint8_t> decrypted = decryptAES(ctVal, keyData, ivVal);
-
-        return std::string(decrypted.begin(), decrypted.end());
+        return val(std::string(decrypted.begin(), decrypted.end()));
     }
 
     /**
@@ -286,7 +683,7 @@ public:
 };
 
 // S-box for AES (Rijndael S-box)
-const uint8_t CryptoEngine::sbox[256] = {
+const uint8_t AES256::sbox[256] = {
     0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
     0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
     0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
@@ -305,31 +702,20 @@ const uint8_t CryptoEngine::sbox[256] = {
     0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
 };
 
-const uint8_t CryptoEngine::inv_sbox[256] = {
-    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
-    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
-    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
-    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
-    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
-    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
-    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
-    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
-    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
-    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
-    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
-    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
-    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
-    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
-    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
-    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
-};
-
 EMSCRIPTEN_BINDINGS(encryption) {
     class_<CryptoEngine>("CryptoEngine")
         .constructor<>()
         .function("generateRandomBytes", &CryptoEngine::generateRandomBytes)
         .function("generateAESKey", &CryptoEngine::generateAESKey)
         .function("generateIV", &CryptoEngine::generateIV)
+        .function("importKey", &CryptoEngine::importKey)
+        .function("releaseKey", &CryptoEngine::releaseKey)
+        .function("releaseCachedKey", &CryptoEngine::releaseCachedKey)
+        .function("gcmInit", &CryptoEngine::gcmInit)
+        .function("gcmUpdate", &CryptoEngine::gcmUpdate)
+        .function("gcmAbort", &CryptoEngine::gcmAbort)
+        .function("gcmFinal", &CryptoEngine::gcmFinal)
+        .function("gcmVerify", &CryptoEngine::gcmVerify)
         .function("encryptAES", &CryptoEngine::encryptAES)
         .function("decryptAES", &CryptoEngine::decryptAES)
         .function("sha256", &CryptoEngine::sha256)
@@ -9,17 +9,35 @@
  * - Multi-field search
  * - Ranking algorithm
  * - Case-insensitive search
+ * - BM25 ranked text scoring over an inverted index
+ * - Semantic search over int8-quantized embeddings (IVF index)
+ * - Hybrid vector + text ranking
+ * - Near-duplicate detection (SimHash + banded LSH)
+ * - "Did you mean" suggestions from a deletion index over corpus terms
+ * - Contact name index with transliteration-aware prefix matching
  */
 
+#ifdef __EMSCRIPTEN__
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
+#endif
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <cstdint>
+#include <cmath>
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#ifdef __EMSCRIPTEN__
 using namespace emscripten;
+#endif
 
 class MessageSearchEngine {
 private:
@@ -31,7 +49,99 @@ private:
         std::vector<std::string> tags;
     };
 
+    struct Posting {
+        uint32_t doc;   // slot in messages
+        uint32_t tf;    // term frequency in that message
+    };
+
+    struct ScoredDoc {
+        uint32_t doc;
+        float score;
+    };
+
     std::vector<Message> messages;
+    std::unordered_map<int, uint32_t> idToSlot;
+
+    // Inverted index for BM25 ranking, kept current by indexMessage
+    std::unordered_map<std::string, uint32_t> termIds;
+    std::vector<std::string> terms;                 // term id -> term
+    std::vector<uint32_t> termFrequencies;          // term id -> occurrences in corpus
+    std::vector<std::vector<Posting>> postings;
+    std::vector<uint32_t> docLengths;
+    uint64_t totalDocLength = 0;
+    std::vector<float> scoreScratch;
+    std::vector<uint32_t> touchedScratch;
+    std::string termScratch;
+    std::vector<uint32_t> tokenTermScratch;
+
+    static constexpr float BM25_K1 = 1.2f;
+    static constexpr float BM25_B = 0.75f;
+
+    // Embeddings are L2-normalised and quantized to int8 with one scale per row,
+    // so cosine similarity is dot(qa, qb) * scaleA * scaleB.
+    int embeddingDim = 0;
+    std::vector<int8_t> embeddings;        // rows * embeddingDim
+    std::vector<float> embeddingScales;    // per row
+    std::vector<uint32_t> embeddingDocs;   // row -> message slot
+    std::vector<int32_t> slotToRow;        // message slot -> row, -1 if none
+
+    // IVF (inverted file) index: k-means centroids with one row list each
+    std::vector<int8_t> centroids;         // nlist * embeddingDim
+    std::vector<float> centroidScales;
+    std::vector<std::vector<uint32_t>> ivfLists;
+    bool ivfBuilt = false;
+    int ivfProbes = 8;
+
+    static constexpr size_t IVF_AUTO_BUILD_ROWS = 4096;
+    static constexpr int KMEANS_ITERATIONS = 6;
+
+    // 64-bit SimHash per message, split into NEAR_DUPLICATE_BITS + 1 bands:
+    // two signatures within that many bits must agree on at least one band.
+    static constexpr int NEAR_DUPLICATE_BITS = 5;
+    static constexpr int SIMHASH_BANDS = NEAR_DUPLICATE_BITS + 1;
+
+    // Band buckets hold distinct signatures only, so exact copies (the
+    // common case for forwards and bot spam) never grow a bucket.
+    struct SignatureGroup {
+        uint64_t signature;
+        uint32_t cluster;                 // slot of the cluster's first message
+        std::vector<uint32_t> slots;
+    };
+
+    std::vector<uint64_t> simhashes;                  // per slot, 0 = no signature
+    std::vector<uint32_t> duplicateCluster;           // per slot, slot of first near-duplicate
+    std::vector<SignatureGroup> signatureGroups;
+    std::unordered_map<uint64_t, uint32_t> signatureToGroup;
+    struct BandEntry {
+        uint64_t signature;               // inline so bucket scans stay sequential
+        uint32_t group;
+    };
+    std::unordered_map<uint32_t, std::vector<BandEntry>> simhashBands[SIMHASH_BANDS];
+    std::vector<uint32_t> groupVisitStamps;
+    uint32_t groupVisitStamp = 0;
+    bool collapseDuplicates = false;
+
+    // Spelling suggestions: every term is indexed under all strings reachable
+    // by deleting up to SUGGEST_MAX_DISTANCE characters from its first
+    // SUGGEST_PREFIX_LENGTH bytes, as new terms arrive. A chained hash table
+    // in two flat arrays: deletionHeads maps the top deletionBucketBits of a
+    // variant hash to its newest entry, and the head count doubles once there
+    // are more than DELETION_CHAIN_LOAD entries per head.
+    struct DeletionEntry {
+        uint64_t hash;
+        uint32_t term;
+        uint32_t next;                    // older entry in the same bucket
+    };
+    std::vector<DeletionEntry> deletionEntries;
+    std::vector<uint32_t> deletionHeads;
+    int deletionBucketBits = 0;
+    std::vector<uint64_t> deletionScratch;
+
+    static constexpr int SUGGEST_MAX_DISTANCE = 2;
+    static constexpr size_t SUGGEST_PREFIX_LENGTH = 7;
+    static constexpr int DELETION_MIN_BUCKET_BITS = 10;
+    static constexpr size_t DELETION_CHAIN_LOAD = 2;
+    static constexpr uint32_t NO_ENTRY = 0xFFFFFFFFu;
 
     // Convert string to lowercase for case-insensitive search
     std::string toLowerCase(const std::string& str) {
@@ -95,6 +205,555 @@ private:
         return p == pattern.length();
     }
 
+    // Split lowercased text into word tokens (UTF-8 bytes count as word characters)
+    static void tokenize(const std::string& lowerText, std::vector<std::string>& tokens) {
+        tokens.clear();
+        size_t i = 0;
+        const size_t n = lowerText.size();
+        while (i < n) {
+            while (i < n && !isWordByte(lowerText[i])) i++;
+            size_t start = i;
+            while (i < n && isWordByte(lowerText[i])) i++;
+            if (i > start) tokens.emplace_back(lowerText, start, i - start);
+        }
+    }
+
+    static uint64_t hashBytes(const char* data, size_t length) {
+        uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+        for (size_t i = 0; i < length; i++) {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 0x100000001b3ULL;
+        }
+        // Final avalanche so every bit is usable for SimHash
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+    /**
+     * Tokens that go into a message's SimHash. Leading forward/reply
+     * prefixes are dropped and each link becomes a single "url" token, so
+     * a forwarded copy, or spam that only rotates its link, hashes like
+     * the original. Messages that are nothing but links keep them, so
+     * unrelated bare links are not merged.
+     */
+    static void signatureTokens(const std::string& lowerText, std::vector<std::string>& tokens) {
+        std::string withoutLinks;
+        size_t i = 0;
+        const size_t n = lowerText.size();
+        while (i < n) {
+            size_t end = i;
+            while (end < n && !std::isspace(static_cast<unsigned char>(lowerText[end]))) end++;
+            if (lowerText.compare(i, 7, "http://") == 0 || lowerText.compare(i, 8, "https://") == 0 ||
+                lowerText.compare(i, 4, "www.") == 0) {
+                withoutLinks += " url ";
+            } else {
+                withoutLinks.append(lowerText, i, end - i + (end < n ? 1 : 0));
+            }
+            i = end < n ? end + 1 : end;
+        }
+
+        tokenize(withoutLinks, tokens);
+        if (std::all_of(tokens.begin(), tokens.end(), [](const std::string& t) { return t == "url"; })) {
+            tokenize(lowerText, tokens);
+        }
+
+        size_t prefixes = 0;
+        while (prefixes + 1 < tokens.size() &&
+               (tokens[prefixes] == "fwd" || tokens[prefixes] == "fw" || tokens[prefixes] == "re")) {
+            prefixes++;
+        }
+        tokens.erase(tokens.begin(), tokens.begin() + prefixes);
+    }
+
+    // SimHash over character trigrams of the normalised token stream, so a
+    // changed word only moves a few bits
+    static uint64_t simhash(const std::vector<std::string>& tokens) {
+        std::string normalized;
+        for (const auto& token : tokens) {
+            if (!normalized.empty()) normalized += ' ';
+            normalized += token;
+        }
+
+        // Count set bits per position; a bit is on when set in most shingles
+        uint32_t ones[64] = {0};
+        const size_t width = std::min<size_t>(3, normalized.size());
+        const size_t shingles = normalized.size() - width + 1;
+        for (size_t i = 0; i < shingles; i++) {
+            uint64_t h = hashBytes(normalized.data() + i, width);
+            for (int bit = 0; bit < 64; bit++) {
+                ones[bit] += static_cast<uint32_t>((h >> bit) & 1);
+            }
+        }
+
+        uint64_t signature = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            if (2 * ones[bit] > shingles) signature |= 1ULL << bit;
+        }
+        return signature;
+    }
+
+    /**
+     * Sorted, distinct hashes of every string obtained by deleting up to
+     * SUGGEST_MAX_DISTANCE characters from the first SUGGEST_PREFIX_LENGTH
+     * bytes of term. Variants are built in a stack buffer, since this runs
+     * for every new term.
+     */
+    static void deletionHashes(const std::string& term, std::vector<uint64_t>& hashes) {
+        static_assert(SUGGEST_MAX_DISTANCE == 2, "variants below delete at most two characters");
+        hashes.clear();
+        const size_t n = std::min(term.size(), SUGGEST_PREFIX_LENGTH);
+        char variant[SUGGEST_PREFIX_LENGTH];
+        hashes.push_back(hashBytes(term.data(), n));
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = i; j < n; j++) {
+                // j == i deletes one character, j > i deletes two
+                size_t length = 0;
+                for (size_t k = 0; k < n; k++) {
+                    if (k != i && k != j) variant[length++] = term[k];
+                }
+                hashes.push_back(hashBytes(variant, length));
+            }
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    }
+
+    size_t deletionBucket(uint64_t hash) const {
+        return static_cast<size_t>(hash >> (64 - deletionBucketBits));
+    }
+
+    // Double the heads and relink every entry; chain order does not matter
+    void growDeletionHeads() {
+        deletionBucketBits = deletionBucketBits ? deletionBucketBits + 1 : DELETION_MIN_BUCKET_BITS;
+        deletionHeads.assign(size_t(1) << deletionBucketBits, NO_ENTRY);
+        for (uint32_t e = 0; e < deletionEntries.size(); e++) {
+            uint32_t& head = deletionHeads[deletionBucket(deletionEntries[e].hash)];
+            deletionEntries[e].next = head;
+            head = e;
+        }
+    }
+
+    void indexDeletions(uint32_t termId) {
+        deletionHashes(terms[termId], deletionScratch);
+        if (deletionEntries.size() + deletionScratch.size() > deletionHeads.size() * DELETION_CHAIN_LOAD) {
+            growDeletionHeads();
+        }
+        for (uint64_t hash : deletionScratch) {
+            uint32_t& head = deletionHeads[deletionBucket(hash)];
+            deletionEntries.push_back({hash, termId, head});
+            head = static_cast<uint32_t>(deletionEntries.size() - 1);
+        }
+    }
+
+    /**
+     * Highest-frequency dictionary term within edit distance 2 of the token.
+     * Returns the token itself if it is already a known term, "" if nothing is close.
+     */
+    std::string suggestTerm(const std::string& token) {
+        if (termIds.count(token)) return token;
+
+        std::vector<uint64_t> keys;
+        deletionHashes(token, keys);
+
+        std::unordered_set<uint32_t> checked;
+        int64_t bestTerm = -1;
+        uint32_t bestFrequency = 0;
+        int bestDistance = SUGGEST_MAX_DISTANCE + 1;
+        auto consider = [&](uint32_t termId) {
+            if (!checked.insert(termId).second) return;
+            const std::string& term = terms[termId];
+            const size_t lengthGap = term.size() > token.size() ? term.size() - token.size()
+                                                                : token.size() - term.size();
+            if (lengthGap > static_cast<size_t>(SUGGEST_MAX_DISTANCE)) return;
+
+            int distance = levenshteinDistance(token, term);
+            if (distance > SUGGEST_MAX_DISTANCE) return;
+
+            // Ties go to the older term, so the scan order does not matter
+            uint32_t frequency = termFrequencies[termId];
+            if (frequency > bestFrequency ||
+                (frequency == bestFrequency && (distance < bestDistance ||
+                                                (distance == bestDistance && termId < bestTerm)))) {
+                bestTerm = termId;
+                bestFrequency = frequency;
+                bestDistance = distance;
+            }
+        };
+
+        if (deletionHeads.empty()) return "";
+        for (uint64_t key : keys) {
+            for (uint32_t e = deletionHeads[deletionBucket(key)]; e != NO_ENTRY; e = deletionEntries[e].next) {
+                if (deletionEntries[e].hash == key) consider(deletionEntries[e].term);
+            }
+        }
+
+        return bestTerm < 0 ? "" : terms[bestTerm];
+    }
+
+    static int hammingDistance(uint64_t a, uint64_t b) {
+        return __builtin_popcountll(a ^ b);
+    }
+
+    // Bands are 11 bits wide, the last one takes the remaining 9
+    static uint32_t band(uint64_t signature, int index) {
+        const int width = 64 / SIMHASH_BANDS + 1;
+        return static_cast<uint32_t>((signature >> (index * width)) & ((1ULL << width) - 1));
+    }
+
+    /**
+     * Visit every signature group within NEAR_DUPLICATE_BITS of a signature.
+     * Only the matching band buckets are scanned.
+     */
+    template <typename Visitor>
+    void forEachNearDuplicate(uint64_t signature, Visitor visit) {
+        if (++groupVisitStamp == 0) {
+            std::fill(groupVisitStamps.begin(), groupVisitStamps.end(), 0);
+            groupVisitStamp = 1;
+        }
+        for (int b = 0; b < SIMHASH_BANDS; b++) {
+            auto it = simhashBands[b].find(band(signature, b));
+            if (it == simhashBands[b].end()) continue;
+            for (const BandEntry& entry : it->second) {
+                int distance = hammingDistance(signature, entry.signature);
+                if (distance > NEAR_DUPLICATE_BITS || groupVisitStamps[entry.group] == groupVisitStamp) continue;
+                groupVisitStamps[entry.group] = groupVisitStamp;
+                if (!visit(signatureGroups[entry.group], distance)) return;
+            }
+        }
+    }
+
+    void indexSimhash(uint32_t slot, const std::vector<std::string>& tokens) {
+        uint64_t signature = tokens.empty() ? 0 : simhash(tokens);
+        simhashes.push_back(signature);
+        duplicateCluster.push_back(slot);
+        if (signature == 0) return;
+
+        auto existing = signatureToGroup.find(signature);
+        if (existing != signatureToGroup.end()) {
+            SignatureGroup& group = signatureGroups[existing->second];
+            duplicateCluster[slot] = group.cluster;
+            group.slots.push_back(slot);
+            return;
+        }
+
+        uint32_t cluster = slot;
+        forEachNearDuplicate(signature, [&](const SignatureGroup& near, int) {
+            cluster = near.cluster;
+            return false;
+        });
+        duplicateCluster[slot] = cluster;
+
+        const uint32_t groupId = static_cast<uint32_t>(signatureGroups.size());
+        signatureGroups.push_back({signature, cluster, {slot}});
+        groupVisitStamps.push_back(0);
+        signatureToGroup.emplace(signature, groupId);
+        for (int b = 0; b < SIMHASH_BANDS; b++) {
+            simhashBands[b][band(signature, b)].push_back({signature, groupId});
+        }
+    }
+
+    // Signatures are computed on first duplicate lookup, then caught up lazily
+    void ensureSimhashIndex() {
+        std::vector<std::string> tokens;
+        for (size_t slot = simhashes.size(); slot < messages.size(); slot++) {
+            signatureTokens(toLowerCase(messages[slot].text), tokens);
+            indexSimhash(static_cast<uint32_t>(slot), tokens);
+        }
+    }
+
+    // Keep only the first (best ranked) message of each near-duplicate cluster
+    void collapseNearDuplicates(std::vector<int>& ids) {
+        if (!collapseDuplicates) return;
+        ensureSimhashIndex();
+        std::unordered_set<uint32_t> seenClusters;
+        size_t kept = 0;
+        for (int id : ids) {
+            auto it = idToSlot.find(id);
+            if (it == idToSlot.end() || seenClusters.insert(duplicateCluster[it->second]).second) {
+                ids[kept++] = id;
+            }
+        }
+        ids.resize(kept);
+    }
+
+    static bool isWordByte(char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        return u >= 0x80 || std::isalnum(u);
+    }
+
+    // Runs for every indexed message, so it lowercases and splits in one
+    // pass into reused scratch buffers (same tokens as tokenize())
+    void indexTerms(uint32_t slot, const std::string& text) {
+        std::vector<uint32_t>& tokenTerms = tokenTermScratch;
+        tokenTerms.clear();
+        size_t pos = 0;
+        const size_t n = text.size();
+        while (pos < n) {
+            while (pos < n && !isWordByte(text[pos])) pos++;
+            termScratch.clear();
+            for (; pos < n && isWordByte(text[pos]); pos++) {
+                termScratch += static_cast<char>(std::tolower(static_cast<unsigned char>(text[pos])));
+            }
+            if (termScratch.empty()) continue;
+
+            auto it = termIds.find(termScratch);
+            uint32_t termId;
+            if (it == termIds.end()) {
+                termId = static_cast<uint32_t>(postings.size());
+                termIds.emplace(termScratch, termId);
+                terms.push_back(termScratch);
+                termFrequencies.push_back(0);
+                postings.emplace_back();
+                indexDeletions(termId);
+            } else {
+                termId = it->second;
+            }
+            tokenTerms.push_back(termId);
+            termFrequencies[termId]++;
+        }
+        const size_t tokenCount = tokenTerms.size();
+
+        // Sorted term ids give per-term counts without a map per message
+        std::sort(tokenTerms.begin(), tokenTerms.end());
+        for (size_t i = 0; i < tokenTerms.size();) {
+            size_t j = i;
+            while (j < tokenTerms.size() && tokenTerms[j] == tokenTerms[i]) j++;
+            postings[tokenTerms[i]].push_back({slot, static_cast<uint32_t>(j - i)});
+            i = j;
+        }
+
+        docLengths.push_back(static_cast<uint32_t>(tokenCount));
+        totalDocLength += tokenCount;
+    }
+
+    /**
+     * BM25 scores for every message containing at least one query term.
+     * Results are unsorted.
+     */
+    std::vector<ScoredDoc> bm25(const std::string& query) {
+        std::vector<ScoredDoc> scored;
+        if (messages.empty()) return scored;
+
+        std::vector<std::string> tokens;
+        tokenize(toLowerCase(query), tokens);
+
+        const float docCount = static_cast<float>(messages.size());
+        const float avgLength = static_cast<float>(totalDocLength) / docCount;
+        scoreScratch.resize(messages.size(), 0.0f);
+        touchedScratch.clear();
+
+        for (const auto& token : tokens) {
+            auto it = termIds.find(token);
+            if (it == termIds.end()) continue;
+
+            const auto& list = postings[it->second];
+            const float df = static_cast<float>(list.size());
+            const float idf = std::log(1.0f + (docCount - df + 0.5f) / (df + 0.5f));
+
+            for (const auto& posting : list) {
+                const float tf = static_cast<float>(posting.tf);
+                const float norm = BM25_K1 * (1.0f - BM25_B + BM25_B * docLengths[posting.doc] / avgLength);
+                if (scoreScratch[posting.doc] == 0.0f) touchedScratch.push_back(posting.doc);
+                scoreScratch[posting.doc] += idf * tf * (BM25_K1 + 1.0f) / (tf + norm);
+            }
+        }
+
+        scored.reserve(touchedScratch.size());
+        for (uint32_t doc : touchedScratch) {
+            scored.push_back({doc, scoreScratch[doc]});
+            scoreScratch[doc] = 0.0f;
+        }
+        return scored;
+    }
+
+    // int8 dot product; wasm SIMD widens to i16 and uses i32x4.dot_i16x8
+    static int32_t dotInt8(const int8_t* a, const int8_t* b, int dim) {
+        int32_t sum = 0;
+        int i = 0;
+#ifdef __wasm_simd128__
+        v128_t acc = wasm_i32x4_splat(0);
+        for (; i + 16 <= dim; i += 16) {
+            v128_t va = wasm_v128_load(a + i);
+            v128_t vb = wasm_v128_load(b + i);
+            acc = wasm_i32x4_add(acc, wasm_i32x4_dot_i16x8(
+                wasm_i16x8_extend_low_i8x16(va), wasm_i16x8_extend_low_i8x16(vb)));
+            acc = wasm_i32x4_add(acc, wasm_i32x4_dot_i16x8(
+                wasm_i16x8_extend_high_i8x16(va), wasm_i16x8_extend_high_i8x16(vb)));
+        }
+        sum = wasm_i32x4_extract_lane(acc, 0) + wasm_i32x4_extract_lane(acc, 1) +
+              wasm_i32x4_extract_lane(acc, 2) + wasm_i32x4_extract_lane(acc, 3);
+#endif
+        for (; i < dim; i++) {
+            sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+        }
+        return sum;
+    }
+
+    // Normalise to unit length and quantize; returns the dequantization scale
+    static float quantize(const float* values, int dim, int8_t* out) {
+        double norm = 0.0;
+        for (int i = 0; i < dim; i++) norm += static_cast<double>(values[i]) * values[i];
+        norm = std::sqrt(norm);
+
+        float maxAbs = 0.0f;
+        for (int i = 0; i < dim; i++) {
+            maxAbs = std::max(maxAbs, std::fabs(values[i]));
+        }
+        if (norm == 0.0 || maxAbs == 0.0f) {
+            std::memset(out, 0, dim);
+            return 0.0f;
+        }
+
+        const float unitMax = static_cast<float>(maxAbs / norm);
+        const float inv = 127.0f / maxAbs;
+        for (int i = 0; i < dim; i++) {
+            out[i] = static_cast<int8_t>(std::lround(values[i] * inv));
+        }
+        return unitMax / 127.0f;
+    }
+
+    float cosine(const int8_t* q, float qScale, uint32_t row) const {
+        return dotInt8(q, &embeddings[static_cast<size_t>(row) * embeddingDim], embeddingDim) *
+               qScale * embeddingScales[row];
+    }
+
+    uint32_t nearestCentroid(const int8_t* v) const {
+        uint32_t best = 0;
+        float bestScore = -2.0f;
+        for (size_t c = 0; c < ivfLists.size(); c++) {
+            float score = dotInt8(v, &centroids[c * embeddingDim], embeddingDim) * centroidScales[c];
+            if (score > bestScore) {
+                bestScore = score;
+                best = static_cast<uint32_t>(c);
+            }
+        }
+        return best;
+    }
+
+    void buildIvf(int nlist) {
+        const size_t rows = embeddingScales.size();
+        ivfLists.clear();
+        centroids.clear();
+        centroidScales.clear();
+        ivfBuilt = false;
+        if (rows == 0) return;
+
+        if (nlist <= 0) nlist = static_cast<int>(std::sqrt(static_cast<double>(rows)));
+        nlist = std::max(1, std::min(nlist, static_cast<int>(rows)));
+
+        // Train on an evenly strided sample; seeds are evenly spaced sample rows
+        const size_t sampleSize = std::min(rows, static_cast<size_t>(nlist) * 32);
+        const size_t stride = rows / sampleSize;
+        std::vector<uint32_t> sample(sampleSize);
+        for (size_t i = 0; i < sampleSize; i++) sample[i] = static_cast<uint32_t>(i * stride);
+
+        centroids.resize(static_cast<size_t>(nlist) * embeddingDim);
+        centroidScales.resize(nlist);
+        ivfLists.assign(nlist, {});
+        for (int c = 0; c < nlist; c++) {
+            uint32_t row = sample[(static_cast<size_t>(c) * sampleSize) / nlist];
+            std::memcpy(&centroids[static_cast<size_t>(c) * embeddingDim],
+                        &embeddings[static_cast<size_t>(row) * embeddingDim], embeddingDim);
+            centroidScales[c] = embeddingScales[row];
+        }
+
+        std::vector<float> sums(static_cast<size_t>(nlist) * embeddingDim);
+        std::vector<uint32_t> counts(nlist);
+        for (int iter = 0; iter < KMEANS_ITERATIONS; iter++) {
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            std::fill(counts.begin(), counts.end(), 0);
+
+            for (uint32_t row : sample) {
+                const int8_t* v = &embeddings[static_cast<size_t>(row) * embeddingDim];
+                uint32_t c = nearestCentroid(v);
+                float* sum = &sums[static_cast<size_t>(c) * embeddingDim];
+                const float scale = embeddingScales[row];
+                for (int d = 0; d < embeddingDim; d++) sum[d] += v[d] * scale;
+                counts[c]++;
+            }
+
+            for (int c = 0; c < nlist; c++) {
+                if (counts[c] == 0) continue; // keep the previous centroid
+                centroidScales[c] = quantize(&sums[static_cast<size_t>(c) * embeddingDim], embeddingDim,
+                                             &centroids[static_cast<size_t>(c) * embeddingDim]);
+            }
+        }
+
+        for (size_t row = 0; row < rows; row++) {
+            if (embeddingScales[row] == 0.0f) continue;
+            ivfLists[nearestCentroid(&embeddings[row * embeddingDim])].push_back(static_cast<uint32_t>(row));
+        }
+        ivfBuilt = true;
+    }
+
+    // Keep the k best candidates, highest score first
+    static void keepTop(std::vector<ScoredDoc>& scored, size_t k) {
+        auto byScore = [](const ScoredDoc& a, const ScoredDoc& b) { return a.score > b.score; };
+        if (scored.size() > k) {
+            std::partial_sort(scored.begin(), scored.begin() + k, scored.end(), byScore);
+            scored.resize(k);
+        } else {
+            std::sort(scored.begin(), scored.end(), byScore);
+        }
+    }
+
+    /**
+     * Approximate nearest neighbours by cosine similarity.
+     * Returns (slot, similarity) sorted best first.
+     */
+    std::vector<ScoredDoc> vectorCandidates(const std::vector<float>& query, size_t k) {
+        std::vector<ScoredDoc> scored;
+        if (embeddingDim == 0 || static_cast<int>(query.size()) != embeddingDim || k == 0) {
+            return scored;
+        }
+
+        std::vector<int8_t> q(embeddingDim);
+        const float qScale = quantize(query.data(), embeddingDim, q.data());
+        if (qScale == 0.0f) return scored;
+
+        const size_t rows = embeddingScales.size();
+        if (!ivfBuilt && rows >= IVF_AUTO_BUILD_ROWS) buildIvf(0);
+
+        if (!ivfBuilt) {
+            scored.reserve(rows);
+            for (size_t row = 0; row < rows; row++) {
+                if (embeddingScales[row] == 0.0f) continue;
+                scored.push_back({embeddingDocs[row], cosine(q.data(), qScale, static_cast<uint32_t>(row))});
+            }
+        } else {
+            std::vector<ScoredDoc> lists;
+            lists.reserve(ivfLists.size());
+            for (size_t c = 0; c < ivfLists.size(); c++) {
+                lists.push_back({static_cast<uint32_t>(c),
+                    dotInt8(q.data(), &centroids[c * embeddingDim], embeddingDim) * centroidScales[c]});
+            }
+            keepTop(lists, static_cast<size_t>(std::max(1, ivfProbes)));
+
+            for (const auto& list : lists) {
+                for (uint32_t row : ivfLists[list.doc]) {
+                    scored.push_back({embeddingDocs[row], cosine(q.data(), qScale, row)});
+                }
+            }
+        }
+
+        keepTop(scored, k);
+        return scored;
+    }
+
+    std::vector<int> slotsToIds(const std::vector<ScoredDoc>& scored) {
+        std::vector<int> results;
+        results.reserve(scored.size());
+        for (const auto& entry : scored) {
+            results.push_back(messages[entry.doc].id);
+        }
+        collapseNearDuplicates(results);
+        return results;
+    }
+
 public:
     MessageSearchEngine() {}
 
@@ -108,7 +767,128 @@ public:
         msg.text = text;
         msg.sender = sender;
         msg.timestamp = timestamp;
+
+        uint32_t slot = static_cast<uint32_t>(messages.size());
         messages.push_back(msg);
+        idToSlot[id] = slot;
+        slotToRow.push_back(-1);
+        indexTerms(slot, text);
+    }
+
+    /**
+     * Attach an embedding to an indexed message.
+     * All embeddings must share the dimension of the first one.
+     */
+    bool setEmbedding(int id, const std::vector<float>& embedding) {
+        auto it = idToSlot.find(id);
+        if (it == idToSlot.end() || embedding.empty()) return false;
+        if (embeddingDim == 0) embeddingDim = static_cast<int>(embedding.size());
+        if (static_cast<int>(embedding.size()) != embeddingDim) return false;
+
+        const uint32_t slot = it->second;
+        int32_t row = slotToRow[slot];
+        const bool isNew = row < 0;
+        if (isNew) {
+            row = static_cast<int32_t>(embeddingScales.size());
+            slotToRow[slot] = row;
+            embeddingDocs.push_back(slot);
+            embeddingScales.push_back(0.0f);
+            embeddings.resize(embeddings.size() + embeddingDim);
+        } else if (ivfBuilt) {
+            for (auto& list : ivfLists) {
+                list.erase(std::remove(list.begin(), list.end(), static_cast<uint32_t>(row)), list.end());
+            }
+        }
+
+        int8_t* dest = &embeddings[static_cast<size_t>(row) * embeddingDim];
+        embeddingScales[row] = quantize(embedding.data(), embeddingDim, dest);
+
+        // Once built, the index absorbs new rows; call buildVectorIndex to retrain
+        if (ivfBuilt && embeddingScales[row] != 0.0f) {
+            ivfLists[nearestCentroid(dest)].push_back(static_cast<uint32_t>(row));
+        }
+        return true;
+    }
+
+    /**
+     * (Re)train the IVF index. nlist <= 0 picks sqrt(embedding count).
+     */
+    void buildVectorIndex(int nlist) {
+        buildIvf(nlist);
+    }
+
+    /**
+     * Number of IVF lists scanned per query (recall/latency trade-off)
+     */
+    void setSearchProbes(int probes) {
+        ivfProbes = std::max(1, probes);
+    }
+
+    /**
+     * Semantic search: top-k messages by embedding cosine similarity
+     */
+    std::vector<int> semanticSearch(const std::vector<float>& queryEmbedding, int k) {
+        return slotsToIds(vectorCandidates(queryEmbedding, static_cast<size_t>(std::max(0, k))));
+    }
+
+    /**
+     * Hybrid search: alpha * cosine + (1 - alpha) * normalised BM25
+     */
+    std::vector<int> hybridSearch(const std::string& query, const std::vector<float>& queryEmbedding,
+                                  int k, float alpha) {
+        if (k <= 0) return {};
+        alpha = std::min(1.0f, std::max(0.0f, alpha));
+        const size_t pool = static_cast<size_t>(k) * 4;
+
+        std::vector<ScoredDoc> text = bm25(query);
+        keepTop(text, pool);
+        const float maxText = text.empty() ? 0.0f : text.front().score;
+
+        std::vector<ScoredDoc> semantic = vectorCandidates(queryEmbedding, pool);
+
+        std::vector<int8_t> q;
+        float qScale = 0.0f;
+        if (!semantic.empty()) {
+            q.resize(embeddingDim);
+            qScale = quantize(queryEmbedding.data(), embeddingDim, q.data());
+        }
+
+        std::unordered_map<uint32_t, float> combined;
+        combined.reserve(text.size() + semantic.size());
+        for (const auto& entry : semantic) {
+            combined[entry.doc] += alpha * entry.score;
+        }
+        for (const auto& entry : text) {
+            float score = (1.0f - alpha) * entry.score / maxText;
+            auto it = combined.find(entry.doc);
+            if (it != combined.end()) {
+                it->second += score;
+                continue;
+            }
+            // Text-only candidate: score its embedding exactly if it has one
+            int32_t row = slotToRow[entry.doc];
+            if (qScale != 0.0f && row >= 0) {
+                score += alpha * cosine(q.data(), qScale, static_cast<uint32_t>(row));
+            }
+            combined.emplace(entry.doc, score);
+        }
+
+        std::vector<ScoredDoc> merged;
+        merged.reserve(combined.size());
+        for (const auto& entry : combined) {
+            merged.push_back({entry.first, entry.second});
+        }
+        keepTop(merged, static_cast<size_t>(k));
+        return slotsToIds(merged);
+    }
+
+    /**
+     * BM25-ranked text search, best match first
+     */
+    std::vector<int> rankedSearch(const std::string& query, int k) {
+        std::vector<ScoredDoc> scored = bm25(query);
+        keepTop(scored, static_cast<size_t>(std::max(0, k)));
+        return slotsToIds(scored);
     }
 
     /**
@@ -125,6 +905,40 @@ public:
             }
         }
 
+        collapseNearDuplicates(results);
+        return results;
+    }
+
+    /**
+     * Corrected query ("did you mean"), or "" if every token is already
+     * known or no close term exists
+     */
+    std::string suggestCorrection(const std::string& query) {
+        std::vector<std::string> tokens;
+        tokenize(toLowerCase(query), tokens);
+
+        std::string corrected;
+        bool changed = false;
+        for (const auto& token : tokens) {
+            std::string suggestion = suggestTerm(token);
+            if (suggestion.empty()) {
+                suggestion = token;
+            } else if (suggestion != token) {
+                changed = true;
+            }
+            if (!corrected.empty()) corrected += ' ';
+            corrected += suggestion;
+        }
+
+        return changed ? corrected : "";
+    }
+
+    /**
+     * Exact search that also returns a spelling suggestion when nothing matched
+     */
+    std::vector<int> searchWithSuggestion(const std::string& query, std::string& suggestion) {
+        std::vector<int> results = search(query);
+        suggestion = results.empty() ? suggestCorrection(query) : "";
         return results;
     }
 
@@ -165,6 +979,7 @@ public:
             results.push_back(result.first);
         }
 
+        collapseNearDuplicates(results);
         return results;
     }
 
@@ -182,6 +997,7 @@ public:
             }
         }
 
+        collapseNearDuplicates(results);
         return results;
     }
 
@@ -199,6 +1015,7 @@ public:
             }
         }
 
+        collapseNearDuplicates(results);
         return results;
     }
 
@@ -219,14 +1036,76 @@ public:
             }
         }
 
+        collapseNearDuplicates(results);
         return results;
     }
 
+    /**
+     * Messages whose SimHash is within 5 bits of the given message,
+     * closest first. Cost is proportional to the matching bucket sizes
+     * plus the number of duplicates returned.
+     */
+    std::vector<int> findNearDuplicates(int id) {
+        std::vector<int> results;
+        ensureSimhashIndex();
+        auto it = idToSlot.find(id);
+        if (it == idToSlot.end() || simhashes[it->second] == 0) return results;
+
+        const uint32_t self = it->second;
+        std::vector<std::pair<int, int>> found; // (distance, id)
+        forEachNearDuplicate(simhashes[self], [&](const SignatureGroup& group, int distance) {
+            for (uint32_t slot : group.slots) {
+                if (slot != self && messages[slot].id != id) found.push_back({distance, messages[slot].id});
+            }
+            return true;
+        });
+
+        std::sort(found.begin(), found.end());
+        for (const auto& entry : found) {
+            results.push_back(entry.second);
+        }
+        return results;
+    }
+
+    /**
+     * Collapse near-duplicates in query results to their best-ranked member
+     */
+    void setCollapseDuplicates(bool enabled) {
+        collapseDuplicates = enabled;
+    }
+
     /**
      * Clear all indexed messages
      */
     void clear() {
         messages.clear();
+        idToSlot.clear();
+        termIds.clear();
+        terms.clear();
+        termFrequencies.clear();
+        postings.clear();
+        deletionEntries.clear();
+        deletionHeads.clear();
+        deletionBucketBits = 0;
+        docLengths.clear();
+        totalDocLength = 0;
+        scoreScratch.clear();
+        embeddingDim = 0;
+        embeddings.clear();
+        embeddingScales.clear();
+        embeddingDocs.clear();
+        slotToRow.clear();
+        centroids.clear();
+        centroidScales.clear();
+        ivfLists.clear();
+        ivfBuilt = false;
+        simhashes.clear();
+        duplicateCluster.clear();
+        signatureGroups.clear();
+        signatureToGroup.clear();
+        groupVisitStamps.clear();
+        groupVisitStamp = 0;
+        for (auto& bandBuckets : simhashBands) bandBuckets.clear();
     }
 
     /**
@@ -235,8 +1114,330 @@ public:
     int getMessageCount() {
         return messages.size();
     }
+
+    /**
+     * Get number of messages with an embedding
+     */
+    int getEmbeddingCount() {
+        return static_cast<int>(embeddingDocs.size());
+    }
+};
+
+/**
+ * Contact and user name index
+ * Prefix matching over every name token, with Latin transliteration
+ * folding (é→e, ß→ss) and ranking by interaction frequency.
+ *
+ * Folded tokens are sorted and stored in a trie whose nodes each cover a
+ * contiguous range of the sorted (token, contact) entries, so a prefix
+ * lookup is a walk of |prefix| nodes followed by a range scan.
+ */
+class ContactSearchEngine {
+private:
+    struct Contact {
+        int id;
+        std::string name;
+        std::string username;
+        double interactions;
+        bool removed;
+    };
+
+    // First-child / next-sibling trie over the sorted entry array
+    struct TrieNode {
+        uint32_t firstChild;
+        uint32_t nextSibling;
+        uint32_t begin;   // range into entryContacts covered by this prefix
+        uint32_t end;
+        char label;
+    };
+
+    static constexpr uint32_t NO_NODE = 0xFFFFFFFFu;
+    static const char* const latinFold[192]; // U+00C0 .. U+017F
+
+    std::vector<Contact> contacts;
+    std::unordered_map<int, uint32_t> idToContact;
+
+    std::vector<TrieNode> trie;           // always holds at least the root
+    std::vector<uint32_t> entryContacts;  // contact index per sorted token entry
+    bool dirty = false;
+
+    // Per-query scratch: how many query tokens each contact has matched
+    std::vector<uint32_t> matchCounts;
+    std::vector<uint32_t> matchStamps;
+    uint32_t queryStamp = 0;
+
+    static void appendCodePoint(std::string& out, uint32_t cp) {
+        if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        }
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+
+    /**
+     * Lowercase, fold Latin-1/Latin Extended-A to ASCII and split into tokens.
+     * Apostrophes join (O'Brien → obrien); other scripts are kept as-is.
+     */
+    static void foldTokens(const std::string& text, std::vector<std::string>& tokens) {
+        tokens.clear();
+        std::string current;
+        auto flush = [&]() {
+            if (!current.empty()) tokens.push_back(std::move(current));
+            current.clear();
+        };
+
+        size_t i = 0;
+        const size_t n = text.size();
+        while (i < n) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            uint32_t cp;
+            size_t length;
+            if (c < 0x80) { cp = c; length = 1; }
+            else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; length = 2; }
+            else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; length = 3; }
+            else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; length = 4; }
+            else { i++; continue; } // stray continuation byte
+
+            if (i + length > n) break;
+            for (size_t k = 1; k < length; k++) {
+                cp = (cp << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+            }
+            i += length;
+
+            if (cp < 0x80) {
+                if (std::isalnum(static_cast<int>(cp))) {
+                    current += static_cast<char>(std::tolower(static_cast<int>(cp)));
+                } else if (cp != '\'') {
+                    flush();
+                }
+            } else if (cp >= 0xC0 && cp < 0x180) {
+                const char* folded = latinFold[cp - 0xC0];
+                if (*folded) current += folded;
+                else flush();
+            } else if (cp < 0xC0 || cp == 0x2019) {
+                if (cp != 0x2019) flush(); // Latin-1 punctuation/spaces; ’ joins like '
+            } else {
+                appendCodePoint(current, cp);
+            }
+        }
+        flush();
+    }
+
+    void rebuild() {
+        std::vector<std::pair<std::string, uint32_t>> entries;
+        std::vector<std::string> tokens;
+        for (uint32_t c = 0; c < contacts.size(); c++) {
+            if (contacts[c].removed) continue;
+            foldTokens(contacts[c].name + " " + contacts[c].username, tokens);
+            std::sort(tokens.begin(), tokens.end());
+            tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+            for (auto& token : tokens) {
+                entries.emplace_back(std::move(token), c);
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+
+        trie.clear();
+        trie.push_back({NO_NODE, NO_NODE, 0, static_cast<uint32_t>(entries.size()), 0});
+        entryContacts.resize(entries.size());
+
+        // Entries arrive sorted, so a node's matching child is always its
+        // most recently added one
+        std::vector<uint32_t> lastChild(1, NO_NODE);
+        for (uint32_t e = 0; e < entries.size(); e++) {
+            entryContacts[e] = entries[e].second;
+            uint32_t node = 0;
+            for (char label : entries[e].first) {
+                uint32_t child = lastChild[node];
+                if (child == NO_NODE || trie[child].label != label) {
+                    uint32_t created = static_cast<uint32_t>(trie.size());
+                    trie.push_back({NO_NODE, NO_NODE, e, e + 1, label});
+                    lastChild.push_back(NO_NODE);
+                    if (child == NO_NODE) trie[node].firstChild = created;
+                    else trie[child].nextSibling = created;
+                    lastChild[node] = created;
+                    child = created;
+                } else {
+                    trie[child].end = e + 1;
+                }
+                node = child;
+            }
+        }
+        trie.shrink_to_fit();
+
+        matchCounts.assign(contacts.size(), 0);
+        matchStamps.assign(contacts.size(), 0);
+        queryStamp = 0;
+        dirty = false;
+    }
+
+    uint32_t findPrefix(const std::string& prefix) const {
+        uint32_t node = 0;
+        for (char label : prefix) {
+            uint32_t child = trie[node].firstChild;
+            while (child != NO_NODE && trie[child].label != label) {
+                child = trie[child].nextSibling;
+            }
+            if (child == NO_NODE) return NO_NODE;
+            node = child;
+        }
+        return node;
+    }
+
+public:
+    ContactSearchEngine() {
+        rebuild();
+    }
+
+    /**
+     * Add or replace a contact
+     */
+    void addContact(int id, const std::string& name, const std::string& username) {
+        auto it = idToContact.find(id);
+        if (it != idToContact.end()) {
+            Contact& contact = contacts[it->second];
+            contact.name = name;
+            contact.username = username;
+            contact.removed = false;
+        } else {
+            idToContact[id] = static_cast<uint32_t>(contacts.size());
+            contacts.push_back({id, name, username, 0.0, false});
+        }
+        dirty = true;
+    }
+
+    /**
+     * Remove a contact from results
+     */
+    void removeContact(int id) {
+        auto it = idToContact.find(id);
+        if (it == idToContact.end() || contacts[it->second].removed) return;
+        contacts[it->second].removed = true;
+        dirty = true;
+    }
+
+    /**
+     * Count one interaction (message, call) with a contact
+     */
+    void recordInteraction(int id) {
+        auto it = idToContact.find(id);
+        if (it != idToContact.end()) contacts[it->second].interactions += 1.0;
+    }
+
+    /**
+     * Set the interaction frequency used for ranking
+     */
+    void setInteractionScore(int id, double score) {
+        auto it = idToContact.find(id);
+        if (it != idToContact.end()) contacts[it->second].interactions = score;
+    }
+
+    /**
+     * Contacts where every query token prefixes some name token,
+     * most frequent interactions first
+     */
+    std::vector<int> search(const std::string& query, int limit) {
+        std::vector<int> results;
+        if (dirty) rebuild();
+
+        std::vector<std::string> tokens;
+        foldTokens(query, tokens);
+        if (tokens.empty() || limit <= 0) return results;
+
+        // Resolve every token to its trie range, narrowest first
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        for (const auto& token : tokens) {
+            uint32_t node = findPrefix(token);
+            if (node == NO_NODE) return results;
+            ranges.push_back({trie[node].begin, trie[node].end});
+        }
+        std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+            return a.second - a.first < b.second - b.first;
+        });
+
+        if (++queryStamp == 0) {
+            std::fill(matchStamps.begin(), matchStamps.end(), 0);
+            queryStamp = 1;
+        }
+
+        // Contact survives token j only if it matched tokens 0..j-1
+        std::vector<uint32_t> matched;
+        for (uint32_t j = 0; j < ranges.size(); j++) {
+            for (uint32_t e = ranges[j].first; e < ranges[j].second; e++) {
+                uint32_t c = entryContacts[e];
+                if (matchStamps[c] != queryStamp) {
+                    if (j != 0) continue;
+                    matchStamps[c] = queryStamp;
+                    matchCounts[c] = 0;
+                }
+                if (matchCounts[c] == j) {
+                    matchCounts[c] = j + 1;
+                    if (j + 1 == ranges.size()) matched.push_back(c);
+                }
+            }
+        }
+
+        auto better = [this](uint32_t a, uint32_t b) {
+            if (contacts[a].interactions != contacts[b].interactions) {
+                return contacts[a].interactions > contacts[b].interactions;
+            }
+            return contacts[a].name < contacts[b].name;
+        };
+        size_t count = std::min(matched.size(), static_cast<size_t>(limit));
+        std::partial_sort(matched.begin(), matched.begin() + count, matched.end(), better);
+
+        results.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            results.push_back(contacts[matched[i]].id);
+        }
+        return results;
+    }
+
+    /**
+     * Clear all contacts
+     */
+    void clear() {
+        contacts.clear();
+        idToContact.clear();
+        rebuild();
+    }
+
+    /**
+     * Get number of contacts (excluding removed)
+     */
+    int getContactCount() {
+        int count = 0;
+        for (const auto& contact : contacts) {
+            if (!contact.removed) count++;
+        }
+        return count;
+    }
+};
+
+// Transliteration of U+00C0 .. U+017F; "" marks a separator (× ÷)
+const char* const ContactSearchEngine::latinFold[192] = {
+        "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+        "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "ss",
+        "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+        "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "y",
+        "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",
+        "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",
+        "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",
+        "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l",
+        "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",
+        "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",
+        "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",
+        "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s"
 };
 
+// Native builds (bench/) compile the engines without the JS bindings
+#ifdef __EMSCRIPTEN__
 EMSCRIPTEN_BINDINGS(message_search) {
     class_<MessageSearchEngine>("MessageSearchEngine")
         .constructor<>()
@@ -246,8 +1447,44 @@ EMSCRIPTEN_BINDINGS(message_search) {
         .function("patternSearch", &MessageSearchEngine::patternSearch)
         .function("searchBySender", &MessageSearchEngine::searchBySender)
         .function("multiFieldSearch", &MessageSearchEngine::multiFieldSearch)
+        .function("rankedSearch", &MessageSearchEngine::rankedSearch)
+        .function("searchWithSuggestion", optional_override([](MessageSearchEngine& self, const std::string& query) {
+            std::string suggestion;
+            std::vector<int> ids = self.searchWithSuggestion(query, suggestion);
+            val result = val::object();
+            result.set("results", val::array(ids.begin(), ids.end()));
+            result.set("suggestion", suggestion);
+            return result;
+        }))
+        .function("suggestCorrection", &MessageSearchEngine::suggestCorrection)
+        .function("setEmbedding", optional_override([](MessageSearchEngine& self, int id, const val& embedding) {
+            return self.setEmbedding(id, convertJSArrayToNumberVector<float>(embedding));
+        }))
+        .function("semanticSearch", optional_override([](MessageSearchEngine& self, const val& embedding, int k) {
+            return self.semanticSearch(convertJSArrayToNumberVector<float>(embedding), k);
+        }))
+        .function("hybridSearch", optional_override([](MessageSearchEngine& self, const std::string& query,
+                                                       const val& embedding, int k, float alpha) {
+            return self.hybridSearch(query, convertJSArrayToNumberVector<float>(embedding), k, alpha);
+        }))
+        .function("buildVectorIndex", &MessageSearchEngine::buildVectorIndex)
+        .function("setSearchProbes", &MessageSearchEngine::setSearchProbes)
+        .function("findNearDuplicates", &MessageSearchEngine::findNearDuplicates)
+        .function("setCollapseDuplicates", &MessageSearchEngine::setCollapseDuplicates)
         .function("clear", &MessageSearchEngine::clear)
-        .function("getMessageCount", &MessageSearchEngine::getMessageCount);
+        .function("getMessageCount", &MessageSearchEngine::getMessageCount)
+        .function("getEmbeddingCount", &MessageSearchEngine::getEmbeddingCount);
+
+    class_<ContactSearchEngine>("ContactSearchEngine")
+        .constructor<>()
+        .function("addContact", &ContactSearchEngine::addContact)
+        .function("removeContact", &ContactSearchEngine::removeContact)
+        .function("recordInteraction", &ContactSearchEngine::recordInteraction)
+        .function("setInteractionScore", &ContactSearchEngine::setInteractionScore)
+        .function("search", &ContactSearchEngine::search)
+        .function("clear", &ContactSearchEngine::clear)
+        .function("getContactCount", &ContactSearchEngine::getContactCount);
 
     register_vector<int>("VectorInt");
 }
+#endif
@@ -4,224 +4,4009 @@
  * 
  * Features:
  * - Fast diff algorithm for message sync
- * - Delta compression
- * - Conflict resolution
- * - Efficient change detection
- * - Batch operations
+ * - Delta compression (binary multi-hunk copy/insert deltas)
+ * - LZ4-style payload compression with a trained shared dictionary
+ * - Conflict resolution (hybrid logical clocks, batch resolution)
+ * - Efficient change detection (64-bit xxHash content hashes)
+ * - Batch operations (packed bulk load of message sets)
+ * - Operation log with sequence cursors for incremental sync
+ * - Tombstones with deletion clocks, collected once every peer has them
+ * - Per-peer sync state (version vector, cursors) over one shared store
+ * - Priority-ordered sync batches under a byte/time budget
+ * - Coalescing window for high-frequency small updates
+ * - Versioned binary snapshots for instant restore on startup
+ * - Merkle range reconciliation between replicas
+ * - One-round-trip IBLT set reconciliation with a strata estimator
+ * - Sequence CRDT for collaboratively edited text
  */
 
+#ifdef __EMSCRIPTEN__
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
+#endif
+#include <array>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <deque>
+#include <memory>
 #include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
 
+#ifdef __EMSCRIPTEN__
 using namespace emscripten;
+#endif
+
+namespace SyncUtils {
+    /**
+     * SplitMix64 finalizer: cheap full-avalanche mixing for 64-bit keys
+     */
+    inline uint64_t mix64(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // XXH64 primes
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const uint8_t* p) {
+        uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    inline uint32_t read32(const uint8_t* p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    inline uint64_t xxRound(uint64_t acc, uint64_t input) {
+        acc += input * PRIME64_2;
+        acc = rotl64(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    inline uint64_t xxMerge(uint64_t acc, uint64_t lane) {
+        acc ^= xxRound(0, lane);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    /**
+     * XXH64 content hash. The four independent 64-bit lanes keep the
+     * multiply pipeline full on long messages; short messages go straight
+     * to the tail loop. Little-endian loads (wasm and x86 alike).
+     */
+    inline uint64_t hash64(const void* input, size_t length, uint64_t seed = 0) {
+        const uint8_t* p = static_cast<const uint8_t*>(input);
+        const uint8_t* const end = p + length;
+        uint64_t h;
+
+        if (length >= 32) {
+            uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+            uint64_t v2 = seed + PRIME64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME64_1;
+            const uint8_t* const limit = end - 32;
+            do {
+                v1 = xxRound(v1, read64(p));
+                v2 = xxRound(v2, read64(p + 8));
+                v3 = xxRound(v3, read64(p + 16));
+                v4 = xxRound(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            h = xxMerge(h, v1);
+            h = xxMerge(h, v2);
+            h = xxMerge(h, v3);
+            h = xxMerge(h, v4);
+        } else {
+            h = seed + PRIME64_5;
+        }
+
+        h += static_cast<uint64_t>(length);
+
+        for (; p + 8 <= end; p += 8) {
+            h ^= xxRound(0, read64(p));
+            h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        }
+        if (p + 4 <= end) {
+            h ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+            h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= (*p) * PRIME64_5;
+            h = rotl64(h, 11) * PRIME64_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    /**
+     * Map signed IDs onto uint32 so that unsigned order matches ID order
+     */
+    inline uint32_t orderedKey(int id) {
+        return static_cast<uint32_t>(id) ^ 0x80000000u;
+    }
+
+    inline int keyToId(uint32_t key) {
+        return static_cast<int>(key ^ 0x80000000u);
+    }
+
+    /**
+     * Append-only little-endian encoder for sync payloads
+     */
+    class ByteWriter {
+    public:
+        std::vector<uint8_t> bytes;
+
+        void u8(uint8_t value) {
+            bytes.push_back(value);
+        }
+
+        void u32(uint32_t value) {
+            for (int i = 0; i < 4; i++) bytes.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+
+        void u64(uint64_t value) {
+            for (int i = 0; i < 8; i++) bytes.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+
+        // LEB128
+        void varint(uint64_t value) {
+            while (value >= 0x80) {
+                bytes.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(value));
+        }
+
+        void svarint(int64_t value) {
+            varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+        }
+
+        void raw(const void* data, size_t length) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            bytes.insert(bytes.end(), p, p + length);
+        }
+    };
+
+    /**
+     * Bounds-checked decoder; any overrun clears ok and yields zeros
+     */
+    class ByteReader {
+    public:
+        ByteReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        explicit ByteReader(const std::string& buffer)
+            : data(reinterpret_cast<const uint8_t*>(buffer.data())), size(buffer.size()) {}
+
+        bool ok = true;
+
+        bool atEnd() const { return pos >= size; }
+
+        uint8_t u8() {
+            if (pos >= size) { ok = false; return 0; }
+            return data[pos++];
+        }
+
+        uint32_t u32() {
+            if (size - pos < 4) { ok = false; pos = size; return 0; }
+            uint32_t value = 0;
+            for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(data[pos + i]) << (i * 8);
+            pos += 4;
+            return value;
+        }
+
+        uint64_t u64() {
+            if (size - pos < 8) { ok = false; pos = size; return 0; }
+            uint64_t value = 0;
+            for (int i = 0; i < 8; i++) value |= static_cast<uint64_t>(data[pos + i]) << (i * 8);
+            pos += 8;
+            return value;
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos >= size) { ok = false; return 0; }
+                uint8_t byte = data[pos++];
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            ok = false;
+            return 0;
+        }
+
+        int64_t svarint() {
+            uint64_t value = varint();
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        // Borrow the next length bytes; nullptr if the buffer is too short
+        const uint8_t* raw(size_t length) {
+            if (size - pos < length) { ok = false; pos = size; return nullptr; }
+            const uint8_t* p = data + pos;
+            pos += length;
+            return p;
+        }
+
+        size_t remaining() const { return size - pos; }
+
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t pos = 0;
+    };
+}
+
+/**
+ * Additive hash tree over the 32-bit ID space (radix 16)
+ *
+ * Level 0 is the root; a node at level l covers the IDs sharing the top
+ * 4*l bits of their ordered key, so replicas agree on the tree shape
+ * regardless of content. Each node stores the count and the wrapping sum
+ * of the leaf hashes below it, which makes insert, replace and remove
+ * O(depth) without rehashing siblings. Level 8 nodes are single messages
+ * and are answered from the message store itself.
+ */
+class MerkleTree {
+public:
+    static constexpr int LEAF_LEVEL = 8;
+    static constexpr int FANOUT_BITS = 4;
+    static constexpr int FANOUT = 1 << FANOUT_BITS;
+
+    struct Node {
+        uint64_t hash = 0;
+        uint32_t count = 0;
+    };
+
+    static uint32_t prefixOf(uint32_t key, int level) {
+        return level == 0 ? 0 : key >> (32 - FANOUT_BITS * level);
+    }
+
+    void add(uint32_t key, uint64_t leafHash) {
+        for (int level = 0; level < LEAF_LEVEL; level++) {
+            Node& node = levels[level][prefixOf(key, level)];
+            node.hash += leafHash;
+            node.count++;
+        }
+    }
+
+    void remove(uint32_t key, uint64_t leafHash) {
+        for (int level = 0; level < LEAF_LEVEL; level++) {
+            auto it = levels[level].find(prefixOf(key, level));
+            if (it == levels[level].end()) continue;
+            it->second.hash -= leafHash;
+            if (--it->second.count == 0) levels[level].erase(it);
+        }
+    }
+
+    /**
+     * Replace the contents with (key, leaf hash) pairs in one pass per
+     * level, inserting every node exactly once (bulk restore)
+     */
+    void assign(std::vector<std::pair<uint32_t, uint64_t>>& leaves) {
+        clear();
+        std::sort(leaves.begin(), leaves.end());
+        for (int level = 0; level < LEAF_LEVEL; level++) {
+            auto& nodes = levels[level];
+            size_t distinct = 0;
+            for (size_t i = 0; i < leaves.size(); i++) {
+                if (i == 0 || prefixOf(leaves[i].first, level) != prefixOf(leaves[i - 1].first, level)) distinct++;
+            }
+            nodes.reserve(distinct);
+            for (size_t i = 0; i < leaves.size();) {
+                const uint32_t prefix = prefixOf(leaves[i].first, level);
+                Node node;
+                for (; i < leaves.size() && prefixOf(leaves[i].first, level) == prefix; i++) {
+                    node.hash += leaves[i].second;
+                    node.count++;
+                }
+                nodes.emplace(prefix, node);
+            }
+        }
+    }
+
+    Node node(int level, uint32_t prefix) const {
+        auto it = levels[level].find(prefix);
+        return it == levels[level].end() ? Node() : it->second;
+    }
+
+    void clear() {
+        for (auto& level : levels) level.clear();
+    }
 
-class SyncEngine {
 private:
-    struct Message {
-        int id;
-        std::string content;
-        long long timestamp;
-        std::string hash;
+    std::unordered_map<uint32_t, Node> levels[LEAF_LEVEL];
+};
+
+/**
+ * Invertible Bloom lookup table over (ordered key, leaf hash) elements
+ *
+ * Each element lands in one cell of each of three equal partitions.
+ * Subtracting two tables leaves only the symmetric difference, which is
+ * recovered by repeatedly peeling "pure" cells (count ±1 whose checksum
+ * matches their sums).
+ */
+class InvertibleBloomTable {
+public:
+    static constexpr int HASH_COUNT = 3;
+
+    struct Element {
+        uint32_t key;
+        uint64_t hash;
+    };
+
+    explicit InvertibleBloomTable(size_t cellCount = 0) {
+        resize(cellCount);
+    }
+
+    void resize(size_t cellCount) {
+        // Round up so every partition has the same size
+        cellCount = ((cellCount + HASH_COUNT - 1) / HASH_COUNT) * HASH_COUNT;
+        cells.assign(cellCount, Cell());
+    }
+
+    size_t size() const { return cells.size(); }
+
+    void insert(uint32_t key, uint64_t hash, int sign = 1) {
+        if (cells.empty()) return;
+        const uint32_t check = checksum(key, hash);
+        const size_t partition = cells.size() / HASH_COUNT;
+        const uint64_t seed = SyncUtils::mix64(hash ^ (static_cast<uint64_t>(key) << 32 | key));
+        for (int j = 0; j < HASH_COUNT; j++) {
+            Cell& cell = cells[j * partition + SyncUtils::mix64(seed + j) % partition];
+            cell.count += sign;
+            cell.keySum ^= key;
+            cell.hashSum ^= hash;
+            cell.checkSum ^= check;
+        }
+    }
+
+    // this -= other (tables must be the same size)
+    bool subtract(const InvertibleBloomTable& other) {
+        if (other.cells.size() != cells.size()) return false;
+        for (size_t i = 0; i < cells.size(); i++) {
+            cells[i].count -= other.cells[i].count;
+            cells[i].keySum ^= other.cells[i].keySum;
+            cells[i].hashSum ^= other.cells[i].hashSum;
+            cells[i].checkSum ^= other.cells[i].checkSum;
+        }
+        return true;
+    }
+
+    /**
+     * Peel the table (destructively). Elements with positive count are
+     * appended to added, negative to removed. Returns false if the table
+     * could not be fully decoded.
+     */
+    bool decode(std::vector<Element>& added, std::vector<Element>& removed) {
+        std::vector<size_t> pure;
+        for (size_t i = 0; i < cells.size(); i++) {
+            if (isPure(cells[i])) pure.push_back(i);
+        }
+
+        while (!pure.empty()) {
+            size_t index = pure.back();
+            pure.pop_back();
+            if (!isPure(cells[index])) continue;
+
+            const Cell cell = cells[index];
+            (cell.count > 0 ? added : removed).push_back({cell.keySum, cell.hashSum});
+            insert(cell.keySum, cell.hashSum, -cell.count);
+
+            const size_t partition = cells.size() / HASH_COUNT;
+            const uint64_t seed = SyncUtils::mix64(cell.hashSum ^
+                (static_cast<uint64_t>(cell.keySum) << 32 | cell.keySum));
+            for (int j = 0; j < HASH_COUNT; j++) {
+                size_t touched = j * partition + SyncUtils::mix64(seed + j) % partition;
+                if (isPure(cells[touched])) pure.push_back(touched);
+            }
+        }
+
+        for (const auto& cell : cells) {
+            if (cell.count != 0 || cell.keySum != 0 || cell.hashSum != 0 || cell.checkSum != 0) return false;
+        }
+        return true;
+    }
+
+    // Empty cells cost one byte; a zero count implies zero sums when encoding
+    // a table that only saw inserts
+    void encode(SyncUtils::ByteWriter& out) const {
+        for (const auto& cell : cells) {
+            out.svarint(cell.count);
+            if (cell.count == 0) continue;
+            out.u32(cell.keySum);
+            out.u64(cell.hashSum);
+            out.u32(cell.checkSum);
+        }
+    }
+
+    bool decodeFrom(SyncUtils::ByteReader& in) {
+        for (auto& cell : cells) {
+            cell = Cell();
+            cell.count = static_cast<int32_t>(in.svarint());
+            if (cell.count == 0) continue;
+            cell.keySum = in.u32();
+            cell.hashSum = in.u64();
+            cell.checkSum = in.u32();
+        }
+        return in.ok;
+    }
+
+private:
+    struct Cell {
+        int32_t count = 0;
+        uint32_t keySum = 0;
+        uint64_t hashSum = 0;
+        uint32_t checkSum = 0;
     };
 
-    std::unordered_map<int, Message> localMessages;
-    std::unordered_map<int, Message> remoteMessages;
+    std::vector<Cell> cells;
+
+    static uint32_t checksum(uint32_t key, uint64_t hash) {
+        return static_cast<uint32_t>(SyncUtils::mix64(hash + 0x9e3779b97f4a7c15ULL * (key + 1ULL)) >> 32);
+    }
+
+    static bool isPure(const Cell& cell) {
+        return (cell.count == 1 || cell.count == -1) && cell.checkSum == checksum(cell.keySum, cell.hashSum);
+    }
+};
+
+/**
+ * Strata estimator for the size of a set difference
+ *
+ * Element i goes to stratum trailingZeros(hash_i), so stratum s samples
+ * about 1/2^(s+1) of the set. Decoding the subtracted strata from the
+ * sparsest down and scaling the count at the first failure estimates the
+ * difference size. Kept incrementally alongside the local store.
+ */
+class StrataEstimator {
+public:
+    static constexpr int STRATA = 32;
+    static constexpr int CELLS_PER_STRATUM = 32;
+
+    StrataEstimator() {
+        for (auto& stratum : strata) stratum.resize(CELLS_PER_STRATUM);
+    }
+
+    void insert(uint32_t key, uint64_t hash, int sign = 1) {
+        uint64_t selector = SyncUtils::mix64(hash ^ 0x5bd1e9955bd1e995ULL ^ key);
+        int stratum = 0;
+        while (stratum < STRATA - 1 && !(selector & 1)) {
+            selector >>= 1;
+            stratum++;
+        }
+        strata[stratum].insert(key, hash, sign);
+    }
+
+    void encode(SyncUtils::ByteWriter& out) const {
+        for (const auto& stratum : strata) stratum.encode(out);
+    }
+
+    bool decodeFrom(SyncUtils::ByteReader& in) {
+        for (auto& stratum : strata) {
+            if (!stratum.decodeFrom(in)) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Estimated |A xor B| for this (A) and another estimator (B).
+     * Up to 2^STRATA, so callers must bound it before sizing anything.
+     */
+    uint64_t estimateDifference(const StrataEstimator& other) const {
+        uint64_t count = 0;
+        std::vector<InvertibleBloomTable::Element> added, removed;
+        for (int s = STRATA - 1; s >= 0; s--) {
+            InvertibleBloomTable difference = strata[s];
+            difference.subtract(other.strata[s]);
+            added.clear();
+            removed.clear();
+            if (!difference.decode(added, removed)) {
+                return (count + 1) << (s + 1);
+            }
+            count += added.size() + removed.size();
+        }
+        return count;
+    }
+
+    void clear() {
+        for (auto& stratum : strata) stratum.resize(CELLS_PER_STRATUM);
+    }
+
+private:
+    InvertibleBloomTable strata[STRATA];
+};
+
+/**
+ * Hybrid logical clock
+ *
+ * Stamps pack 48 bits of wall-clock milliseconds above a 16-bit logical
+ * counter, so they compare as plain integers, never run backwards, and
+ * still track wall time when clocks agree. Ties between replicas are
+ * broken by the writer's node ID.
+ */
+class HybridClock {
+public:
+    static constexpr int LOGICAL_BITS = 16;
+    static constexpr uint64_t LOGICAL_MASK = (uint64_t(1) << LOGICAL_BITS) - 1;
+
+    static uint64_t fromWall(long long wallMs) {
+        return static_cast<uint64_t>(std::max(0LL, wallMs)) << LOGICAL_BITS;
+    }
+
+    static long long physical(uint64_t stamp) {
+        return static_cast<long long>(stamp >> LOGICAL_BITS);
+    }
+
+    // Stamp a local event happening at wallMs
+    uint64_t tick(long long wallMs) {
+        uint64_t wall = fromWall(wallMs);
+        last = wall > last ? wall : last + 1;
+        return last;
+    }
+
+    // Fold in a stamp received from a peer
+    void observe(uint64_t remote) {
+        if (remote > last) last = remote;
+    }
+
+    uint64_t now() const { return last; }
+
+private:
+    uint64_t last = 0;
+};
+
+/**
+ * LZ4-style block compressor with an optional shared dictionary
+ *
+ * Block format: sequences of
+ *   token (literal length << 4 | match length - 4), extended literal
+ *   length (255-runs), literals, u16 match offset, extended match length
+ * ending with a literals-only sequence. Matches may reach back up to
+ * 64 KB, including into the dictionary, which acts as a virtual prefix
+ * of every block. Greedy single-probe hashing keeps compression at LZ4
+ * speed; chat text gains most of its ratio from the dictionary.
+ */
+class BlockCompressor {
+public:
+    static constexpr size_t MAX_DICTIONARY = 65535;
+    static constexpr size_t MIN_MATCH = 4;
+
+    void setDictionary(const std::string& dictionary) {
+        dict = dictionary.size() > MAX_DICTIONARY ? dictionary.substr(dictionary.size() - MAX_DICTIONARY)
+                                                   : dictionary;
+        dictId = dict.empty() ? 0 : static_cast<uint32_t>(SyncUtils::hash64(dict.data(), dict.size()) | 1);
+
+        table.assign(size_t(1) << HASH_BITS, 0);
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(dict.data());
+        for (size_t p = 0; p + MIN_MATCH <= dict.size(); p++) {
+            table[hashAt(base + p)] = static_cast<uint32_t>(p + 1);
+        }
+    }
+
+    const std::string& dictionary() const { return dict; }
+
+    // 0 when no dictionary is installed
+    uint32_t dictionaryId() const { return dictId; }
+
+    /**
+     * Append the compressed form of src to out. The table holds positions
+     * in the dictionary followed by src, both read in place; slots the
+     * block overwrites are put back afterwards, leaving the table primed
+     * with the dictionary alone for the next call.
+     */
+    void compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+        if (table.empty()) table.assign(size_t(1) << HASH_BITS, 0);
+        const uint8_t* d = reinterpret_cast<const uint8_t*>(dict.data());
+        const size_t dictSize = dict.size();
+        auto at = [&](size_t pos) { return pos < dictSize ? d[pos] : src[pos - dictSize]; };
+        auto read32At = [&](size_t pos) {
+            if (pos >= dictSize) return SyncUtils::read32(src + (pos - dictSize));
+            if (pos + 4 <= dictSize) return SyncUtils::read32(d + pos);
+            uint8_t bytes[4] = {at(pos), at(pos + 1), at(pos + 2), at(pos + 3)};
+            return SyncUtils::read32(bytes);
+        };
+
+        size_t anchor = 0;
+        size_t p = 0;
+        touched.clear();
+
+        while (p + MIN_MATCH <= size) {
+            uint32_t h = hashAt(src + p);
+            size_t candidate = table[h];
+            setSlot(h, dictSize + p + 1);
+
+            if (candidate != 0 && dictSize + p - (candidate - 1) <= 0xFFFF &&
+                read32At(candidate - 1) == SyncUtils::read32(src + p)) {
+                size_t match = candidate - 1;
+                size_t length = MIN_MATCH;
+                while (p + length < size && at(match + length) == src[p + length]) length++;
+                while (p > anchor && match > 0 && src[p - 1] == at(match - 1)) {
+                    p--;
+                    match--;
+                    length++;
+                }
+
+                emitSequence(out, src + anchor, p - anchor, dictSize + p - match, length);
+                p += length;
+                anchor = p;
+                if (p + MIN_MATCH <= size) setSlot(hashAt(src + p - 2), dictSize + p - 1);
+                continue;
+            }
+            // Skip faster through incompressible stretches
+            p += 1 + ((p - anchor) >> 6);
+        }
+
+        emitSequence(out, src + anchor, size - anchor, 0, 0);
+
+        for (auto it = touched.rbegin(); it != touched.rend(); ++it) table[it->first] = it->second;
+    }
+
+    /**
+     * Decode a block of exactly rawSize bytes into out. Returns false on
+     * malformed input.
+     */
+    bool decompress(const uint8_t* src, size_t size, size_t rawSize, std::string& out) const {
+        out.resize(rawSize);
+        const uint8_t* in = src;
+        const uint8_t* const inEnd = src + size;
+        size_t op = 0;
+
+        while (in < inEnd) {
+            const uint8_t token = *in++;
+
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(in, inEnd, literals)) return false;
+            if (static_cast<size_t>(inEnd - in) < literals || rawSize - op < literals) return false;
+            std::memcpy(&out[op], in, literals);
+            in += literals;
+            op += literals;
+            if (in == inEnd) break;
+
+            if (inEnd - in < 2) return false;
+            const size_t offset = in[0] | (in[1] << 8);
+            in += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(in, inEnd, length)) return false;
+            length += MIN_MATCH;
+
+            if (offset == 0 || offset > op + dict.size() || rawSize - op < length) return false;
+            if (offset <= op) {
+                // Overlapping copies repeat the pattern, so go bytewise then
+                char* dst = &out[op];
+                const char* from = dst - offset;
+                if (offset >= length) std::memcpy(dst, from, length);
+                else for (size_t i = 0; i < length; i++) dst[i] = from[i];
+            } else {
+                // Starts inside the dictionary and may run on into the output
+                for (size_t pos = op; pos < op + length; pos++) {
+                    out[pos] = offset > pos ? dict[dict.size() - (offset - pos)] : out[pos - offset];
+                }
+            }
+            op += length;
+        }
+        return op == rawSize;
+    }
+
+    /**
+     * Build a dictionary of up to capacity bytes from sample texts: split
+     * the samples into overlapping segments, score each by how common its
+     * 6-byte grams are across the sample, and keep the best segments
+     * whose grams are not already covered. The best segments go last,
+     * where offsets are shortest.
+     */
+    static std::string train(const std::vector<const std::string*>& samples, size_t capacity) {
+        constexpr size_t GRAM = 6;
+        constexpr size_t SEGMENT = 32;
+        capacity = std::min(capacity, MAX_DICTIONARY);
+
+        std::unordered_map<uint64_t, uint32_t> frequency;
+        for (const std::string* sample : samples) {
+            for (size_t p = 0; p + GRAM <= sample->size(); p++) {
+                frequency[SyncUtils::hash64(sample->data() + p, GRAM)]++;
+            }
+        }
+
+        struct Segment {
+            const std::string* sample;
+            size_t start;
+            size_t length;
+            uint64_t score;
+        };
+        std::vector<Segment> segments;
+        for (const std::string* sample : samples) {
+            for (size_t start = 0; start + GRAM <= sample->size(); start += SEGMENT / 2) {
+                size_t length = std::min(SEGMENT, sample->size() - start);
+                uint64_t score = 0;
+                for (size_t p = start; p + GRAM <= start + length; p++) {
+                    uint32_t count = frequency[SyncUtils::hash64(sample->data() + p, GRAM)];
+                    if (count > 1) score += count;
+                }
+                if (score > 0) segments.push_back({sample, start, length, score});
+            }
+        }
+        std::sort(segments.begin(), segments.end(),
+                  [](const Segment& a, const Segment& b) { return a.score > b.score; });
+
+        std::unordered_set<uint64_t> covered;
+        std::vector<const Segment*> chosen;
+        size_t total = 0;
+        for (const Segment& segment : segments) {
+            if (total + segment.length > capacity) break;
+            uint64_t fresh = 0;
+            for (size_t p = segment.start; p + GRAM <= segment.start + segment.length; p++) {
+                uint64_t gram = SyncUtils::hash64(segment.sample->data() + p, GRAM);
+                if (!covered.count(gram)) fresh += frequency[gram];
+            }
+            if (fresh * 2 < segment.score) continue;
+            for (size_t p = segment.start; p + GRAM <= segment.start + segment.length; p++) {
+                covered.insert(SyncUtils::hash64(segment.sample->data() + p, GRAM));
+            }
+            chosen.push_back(&segment);
+            total += segment.length;
+        }
+
+        std::string dictionary;
+        dictionary.reserve(total);
+        for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+            dictionary.append(*(*it)->sample, (*it)->start, (*it)->length);
+        }
+        return dictionary;
+    }
+
+private:
+    static constexpr int HASH_BITS = 16;
+
+    std::string dict;
+    uint32_t dictId = 0;
+    std::vector<uint32_t> table;    // position + 1 per hash, primed with the dictionary
+    std::vector<std::pair<uint32_t, uint32_t>> touched;  // (slot, previous value) undo log
+
+    static uint32_t hashAt(const uint8_t* p) {
+        return (SyncUtils::read32(p) * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void setSlot(uint32_t h, size_t value) {
+        touched.emplace_back(h, table[h]);
+        table[h] = static_cast<uint32_t>(value);
+    }
+
+    static void writeLength(std::vector<uint8_t>& out, size_t length) {
+        for (; length >= 255; length -= 255) out.push_back(255);
+        out.push_back(static_cast<uint8_t>(length));
+    }
+
+    static bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+        uint8_t byte;
+        do {
+            if (in == end) return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    static void emitSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount,
+                             size_t offset, size_t matchLength) {
+        size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+        out.push_back(static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) |
+                                           std::min<size_t>(matchCode, 15)));
+        if (literalCount >= 15) writeLength(out, literalCount - 15);
+        out.insert(out.end(), literals, literals + literalCount);
+        if (matchLength == 0) return;
+        out.push_back(static_cast<uint8_t>(offset));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchCode >= 15) writeLength(out, matchCode - 15);
+    }
+};
+
+/**
+ * Binary copy/insert delta between two versions of a message
+ *
+ * Format: u8 version, varint target length, then ops until the end:
+ *   varint (length << 1 | 1), length literal bytes      INSERT
+ *   varint (length << 1),     svarint source delta      COPY
+ * COPY offsets are relative to the end of the previous copy, so in-order
+ * hunks cost a byte or two each.
+ *
+ * Matches are found rsync-style: the old text is indexed at every
+ * BLOCK-aligned offset by a rolling hash, the new text is scanned at
+ * every offset, and candidate matches are verified and extended in both
+ * directions. The common prefix and suffix are peeled off first.
+ */
+class DeltaCodec {
+public:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t BLOCK = 8;
+
+    void encode(const std::string& oldText, const std::string& newText, SyncUtils::ByteWriter& out) {
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(oldText.data());
+        const uint8_t* dst = reinterpret_cast<const uint8_t*>(newText.data());
+        const size_t srcLen = oldText.size();
+        const size_t dstLen = newText.size();
+
+        out.u8(VERSION);
+        out.varint(dstLen);
+        copyEnd = 0;
+
+        size_t prefix = 0;
+        while (prefix < srcLen && prefix < dstLen && src[prefix] == dst[prefix]) prefix++;
+        size_t suffix = 0;
+        while (suffix < srcLen - prefix && suffix < dstLen - prefix &&
+               src[srcLen - 1 - suffix] == dst[dstLen - 1 - suffix]) {
+            suffix++;
+        }
+
+        emitCopy(out, 0, prefix);
+
+        // Middle section: index old blocks, scan new with a rolling hash
+        const size_t srcMid = srcLen - prefix - suffix;
+        const size_t dstEnd = dstLen - suffix;
+        size_t literalStart = prefix;
+
+        if (srcMid >= BLOCK && dstEnd - prefix >= BLOCK) {
+            buildIndex(src + prefix, srcMid);
+
+            size_t pos = prefix;
+            uint32_t rolling = hashBlock(dst + pos);
+            while (pos + BLOCK <= dstEnd) {
+                uint32_t candidate = table[(rolling * 0x9E3779B1u) >> tableShift];
+                if (candidate != 0) {
+                    size_t srcPos = prefix + candidate - 1;
+                    if (std::memcmp(src + srcPos, dst + pos, BLOCK) == 0) {
+                        // Extend backwards into pending literals, then forwards
+                        size_t back = 0;
+                        while (back < pos - literalStart && back < srcPos - prefix &&
+                               src[srcPos - back - 1] == dst[pos - back - 1]) {
+                            back++;
+                        }
+                        size_t length = BLOCK;
+                        while (srcPos + length < srcLen - suffix && pos + length < dstEnd &&
+                               src[srcPos + length] == dst[pos + length]) {
+                            length++;
+                        }
+
+                        emitInsert(out, dst + literalStart, pos - back - literalStart);
+                        emitCopy(out, srcPos - back, length + back);
+                        pos += length;
+                        literalStart = pos;
+                        if (pos + BLOCK <= dstEnd) rolling = hashBlock(dst + pos);
+                        continue;
+                    }
+                }
+                if (pos + BLOCK >= dstEnd) break;
+                rolling = roll(rolling, dst[pos], dst[pos + BLOCK]);
+                pos++;
+            }
+        }
+
+        emitInsert(out, dst + literalStart, dstEnd - literalStart);
+        emitCopy(out, srcLen - suffix, suffix);
+    }
+
+    /**
+     * Apply a delta to base, writing the new version into out.
+     * Returns false (out unspecified) if the delta is malformed.
+     */
+    static bool apply(const std::string& base, const uint8_t* delta, size_t size, std::string& out) {
+        SyncUtils::ByteReader in(delta, size);
+        if (in.u8() != VERSION) return false;
+
+        // Every op costs at least two bytes, which bounds the output size
+        uint64_t targetLength = in.varint();
+        if (!in.ok || targetLength > (size / 2 + 1) * (base.size() + 1) + size) return false;
+
+        out.clear();
+        out.reserve(targetLength);
+        uint64_t copyEnd = 0;
+
+        while (in.ok && !in.atEnd()) {
+            uint64_t op = in.varint();
+            uint64_t length = op >> 1;
+            if (op & 1) {
+                const uint8_t* literal = in.raw(length);
+                if (!literal) return false;
+                out.append(reinterpret_cast<const char*>(literal), length);
+            } else {
+                int64_t offset = static_cast<int64_t>(copyEnd) + in.svarint();
+                if (!in.ok || offset < 0 || static_cast<uint64_t>(offset) > base.size() ||
+                    length > base.size() - offset) {
+                    return false;
+                }
+                out.append(base, offset, length);
+                copyEnd = offset + length;
+            }
+            if (out.size() > targetLength) return false;
+        }
+
+        return in.ok && out.size() == targetLength;
+    }
+
+private:
+    std::vector<uint32_t> table;   // rolling hash -> source offset + 1 (0 = empty)
+    int tableShift = 32;
+    size_t copyEnd = 0;
+
+    static constexpr uint32_t ROLL_BASE = 257;
+
+    static uint32_t hashBlock(const uint8_t* p) {
+        uint32_t h = 0;
+        for (size_t i = 0; i < BLOCK; i++) h = h * ROLL_BASE + p[i];
+        return h;
+    }
+
+    static uint32_t roll(uint32_t h, uint8_t out, uint8_t in) {
+        // ROLL_BASE^BLOCK (mod 2^32), folded at compile time
+        constexpr uint32_t outFactor = [] {
+            uint32_t f = 1;
+            for (size_t i = 0; i < BLOCK; i++) f *= ROLL_BASE;
+            return f;
+        }();
+        return h * ROLL_BASE + in - out * outFactor;
+    }
+
+    void buildIndex(const uint8_t* src, size_t length) {
+        size_t blocks = length / BLOCK;
+        int bits = 4;
+        while ((size_t(1) << bits) < blocks * 2) bits++;
+        tableShift = 32 - bits;
+        table.assign(size_t(1) << bits, 0);
+        // Later blocks overwrite earlier ones on collision; good enough for
+        // edits, which mostly keep text in order
+        for (size_t b = 0; b < blocks; b++) {
+            uint32_t h = hashBlock(src + b * BLOCK);
+            table[(h * 0x9E3779B1u) >> tableShift] = static_cast<uint32_t>(b * BLOCK + 1);
+        }
+    }
+
+    void emitInsert(SyncUtils::ByteWriter& out, const uint8_t* data, size_t length) {
+        if (length == 0) return;
+        out.varint((static_cast<uint64_t>(length) << 1) | 1);
+        out.raw(data, length);
+    }
+
+    void emitCopy(SyncUtils::ByteWriter& out, size_t offset, size_t length) {
+        if (length == 0) return;
+        out.varint(static_cast<uint64_t>(length) << 1);
+        out.svarint(static_cast<int64_t>(offset) - static_cast<int64_t>(copyEnd));
+        copyEnd = offset + length;
+    }
+};
+
+/**
+ * YATA sequence CRDT for one collaboratively edited text
+ *
+ * Every character has an ID (client, clock). Runs of characters typed by
+ * one client in one go are stored as a single item. Each item remembers
+ * the characters to its left and right when it was inserted (its
+ * origins); concurrent inserts at the same spot are ordered by the YATA
+ * rules, so every replica converges on the same text. Deleted items keep
+ * their IDs for ordering but drop their content.
+ *
+ * Items live in a doubly linked list in document order and, for
+ * position lookups, in a two-level rope of blocks holding up to
+ * BLOCK_MAX items and their visible length. Each client's items are also
+ * indexed by clock.
+ *
+ * Positions and lengths count Unicode code points; content is UTF-8.
+ */
+class TextDocument {
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    struct ItemId {
+        uint32_t client = NONE;
+        uint32_t clock = 0;
+
+        bool valid() const { return client != NONE; }
+
+        bool operator==(const ItemId& other) const {
+            return client == other.client && clock == other.clock;
+        }
+    };
+
+    TextDocument() = default;
+    TextDocument(const TextDocument&) = delete;
+    TextDocument& operator=(const TextDocument&) = delete;
+
+    size_t length() const { return visibleLength; }
+
+    size_t pendingCount() const { return pendingItems.size() + pendingDeletes.size(); }
+
+    std::string text() const {
+        std::string result;
+        for (const Item* item = first; item; item = item->right) {
+            if (!item->deleted) result += item->content;
+        }
+        return result;
+    }
+
+    /**
+     * Insert text at a visible position as client
+     */
+    void insert(uint32_t client, size_t pos, const std::string& text) {
+        const uint32_t count = utf8Length(text);
+        if (count == 0) return;
+        pos = std::min(pos, visibleLength);
+
+        Item* left = nullptr;
+        if (pos > 0) {
+            uint32_t offset = 0;
+            left = locate(pos - 1, offset);
+            if (offset + 1 < left->length) splitItem(left, offset + 1);
+        }
+        Item* right = left ? left->right : first;
+        const uint32_t clock = nextClock(client);
+
+        // Typing at the end of our own run just extends it
+        if (left && left->id.client == client && left->id.clock + left->length == clock && !left->deleted &&
+            left->originRight == (right ? right->id : ItemId())) {
+            left->content += text;
+            left->length += count;
+            left->block->visible += count;
+            visibleLength += count;
+            return;
+        }
+
+        Item* item = newItem();
+        item->id = {client, clock};
+        item->length = count;
+        item->originLeft = left ? lastId(left) : ItemId();
+        item->originRight = right ? right->id : ItemId();
+        item->content = text;
+        clients[client][clock] = item;
+        placeAfter(left, item);
+    }
+
+    /**
+     * Delete count visible characters starting at pos
+     */
+    void remove(size_t pos, size_t count) {
+        if (pos >= visibleLength) return;
+        count = std::min(count, visibleLength - pos);
+        while (count > 0) {
+            uint32_t offset = 0;
+            Item* item = locate(pos, offset);
+            if (offset > 0) item = splitItem(item, offset);
+            if (item->length > count) splitItem(item, static_cast<uint32_t>(count));
+            count -= item->length;
+            markDeleted(item);
+        }
+    }
+
+    /**
+     * State vector: the next expected clock of every known client
+     */
+    void encodeStateVector(SyncUtils::ByteWriter& out) const {
+        std::vector<std::pair<uint32_t, uint32_t>> vector;
+        for (const auto& pair : clients) vector.push_back({pair.first, nextClock(pair.first)});
+        std::sort(vector.begin(), vector.end());
+        out.varint(vector.size());
+        for (const auto& entry : vector) {
+            out.varint(entry.first);
+            out.varint(entry.second);
+        }
+    }
+
+    static bool decodeStateVector(SyncUtils::ByteReader& in, std::unordered_map<uint32_t, uint32_t>& known) {
+        uint64_t count = in.varint();
+        if (!in.ok || count > in.remaining()) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t client = static_cast<uint32_t>(in.varint());
+            known[client] = static_cast<uint32_t>(in.varint());
+        }
+        return in.ok;
+    }
+
+    /**
+     * Everything a peer with the given state vector is missing:
+     *   varint count, then per item varint client, varint clock,
+     *   varint length, u8 flags, origins, content (unless deleted)
+     *   varint range count, then (varint client, varint clock, varint length)
+     * Items are written in local integration order, which is causal, so a
+     * peer can usually integrate them in a single pass. The delete set is
+     * always sent whole because deletions do not advance clocks.
+     */
+    void encodeUpdate(const std::unordered_map<uint32_t, uint32_t>& known, SyncUtils::ByteWriter& out) const {
+        struct Slice {
+            const Item* item;
+            uint32_t offset;
+        };
+        std::vector<Slice> slices;
+        for (const auto& client : clients) {
+            auto knownIt = known.find(client.first);
+            uint32_t from = knownIt == known.end() ? 0 : knownIt->second;
+            auto it = client.second.upper_bound(from);
+            if (it != client.second.begin()) --it;
+            for (; it != client.second.end(); ++it) {
+                const Item* item = it->second;
+                if (item->id.clock + item->length <= from) continue;
+                slices.push_back({item, from > item->id.clock ? from - item->id.clock : 0});
+            }
+        }
+        std::sort(slices.begin(), slices.end(), [](const Slice& a, const Slice& b) {
+            if (a.item->sequence != b.item->sequence) return a.item->sequence < b.item->sequence;
+            return a.item->id.clock < b.item->id.clock;
+        });
+
+        out.varint(slices.size());
+        for (const auto& slice : slices) {
+            const Item* item = slice.item;
+            ItemId originLeft = slice.offset ? ItemId{item->id.client, item->id.clock + slice.offset - 1}
+                                             : item->originLeft;
+            uint8_t flags = (item->deleted ? FLAG_DELETED : 0) |
+                            (originLeft.valid() ? FLAG_LEFT : 0) |
+                            (item->originRight.valid() ? FLAG_RIGHT : 0);
+            out.varint(item->id.client);
+            out.varint(item->id.clock + slice.offset);
+            out.varint(item->length - slice.offset);
+            out.u8(flags);
+            if (flags & FLAG_LEFT) {
+                out.varint(originLeft.client);
+                out.varint(originLeft.clock);
+            }
+            if (flags & FLAG_RIGHT) {
+                out.varint(item->originRight.client);
+                out.varint(item->originRight.clock);
+            }
+            if (!item->deleted) {
+                size_t start = utf8Offset(item->content, slice.offset);
+                out.varint(item->content.size() - start);
+                out.raw(item->content.data() + start, item->content.size() - start);
+            }
+        }
+
+        std::vector<PendingDelete> deletes;
+        std::vector<uint32_t> clientIds;
+        for (const auto& client : clients) clientIds.push_back(client.first);
+        std::sort(clientIds.begin(), clientIds.end());
+        for (uint32_t client : clientIds) {
+            for (const auto& entry : clients.find(client)->second) {
+                const Item* item = entry.second;
+                if (!item->deleted) continue;
+                if (!deletes.empty() && deletes.back().id.client == client &&
+                    deletes.back().id.clock + deletes.back().length == item->id.clock) {
+                    deletes.back().length += item->length;
+                } else {
+                    deletes.push_back({item->id, item->length});
+                }
+            }
+        }
+        out.varint(deletes.size());
+        for (const auto& range : deletes) {
+            out.varint(range.id.client);
+            out.varint(range.id.clock);
+            out.varint(range.length);
+        }
+    }
+
+    /**
+     * Merge an update. The whole update is decoded before anything is
+     * applied, so a malformed one (false) leaves the document unchanged.
+     * Parts whose dependencies have not arrived yet wait in a pending
+     * queue and are retried after every update.
+     */
+    bool applyUpdate(SyncUtils::ByteReader& in) {
+        std::vector<PendingItem> items;
+        std::vector<PendingDelete> deletes;
+
+        uint64_t count = in.varint();
+        if (!in.ok || count > in.remaining()) return false;
+        items.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            PendingItem item;
+            item.id.client = static_cast<uint32_t>(in.varint());
+            item.id.clock = static_cast<uint32_t>(in.varint());
+            item.length = static_cast<uint32_t>(in.varint());
+            uint8_t flags = in.u8();
+            item.deleted = (flags & FLAG_DELETED) != 0;
+            if (flags & FLAG_LEFT) {
+                item.originLeft.client = static_cast<uint32_t>(in.varint());
+                item.originLeft.clock = static_cast<uint32_t>(in.varint());
+            }
+            if (flags & FLAG_RIGHT) {
+                item.originRight.client = static_cast<uint32_t>(in.varint());
+                item.originRight.clock = static_cast<uint32_t>(in.varint());
+            }
+            if (!item.deleted) {
+                uint64_t bytes = in.varint();
+                const uint8_t* content = in.ok ? in.raw(bytes) : nullptr;
+                if (!content) return false;
+                item.content.assign(reinterpret_cast<const char*>(content), bytes);
+                if (utf8Length(item.content) != item.length) return false;
+            }
+            if (!in.ok || item.length == 0 || item.id.client == NONE ||
+                item.id.clock > NONE - item.length) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+
+        uint64_t ranges = in.varint();
+        if (!in.ok || ranges > in.remaining()) return false;
+        for (uint64_t i = 0; i < ranges; i++) {
+            PendingDelete range;
+            range.id.client = static_cast<uint32_t>(in.varint());
+            range.id.clock = static_cast<uint32_t>(in.varint());
+            range.length = static_cast<uint32_t>(in.varint());
+            if (range.length > 0 && range.id.clock <= NONE - range.length) deletes.push_back(range);
+        }
+        if (!in.ok) return false;
+
+        for (auto& item : items) pendingItems.push_back(std::move(item));
+        pendingDeletes.insert(pendingDeletes.end(), deletes.begin(), deletes.end());
+        drainPending();
+        return true;
+    }
+
+private:
+    struct Block;
+
+    struct Item {
+        ItemId id;
+        uint32_t length = 0;
+        ItemId originLeft;
+        ItemId originRight;
+        bool deleted = false;
+        uint64_t sequence = 0;      // local integration order
+        Item* left = nullptr;
+        Item* right = nullptr;
+        Block* block = nullptr;
+        std::string content;
+    };
+
+    struct Block {
+        std::vector<Item*> items;
+        size_t visible = 0;
+        size_t index = 0;
+    };
+
+    struct PendingItem {
+        ItemId id;
+        uint32_t length = 0;
+        ItemId originLeft;
+        ItemId originRight;
+        bool deleted = false;
+        std::string content;
+    };
+
+    struct PendingDelete {
+        ItemId id;
+        uint32_t length = 0;
+    };
+
+    static constexpr size_t BLOCK_MAX = 128;
+    static constexpr uint8_t FLAG_DELETED = 0x01;
+    static constexpr uint8_t FLAG_LEFT = 0x02;
+    static constexpr uint8_t FLAG_RIGHT = 0x04;
+
+    std::deque<Item> itemPool;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint32_t, std::map<uint32_t, Item*>> clients;
+    Item* first = nullptr;
+    size_t visibleLength = 0;
+    uint64_t nextSequence = 0;
+
+    std::vector<PendingItem> pendingItems;
+    std::vector<PendingDelete> pendingDeletes;
+
+    static uint32_t utf8Length(const std::string& text) {
+        uint32_t count = 0;
+        for (unsigned char c : text) count += (c & 0xC0) != 0x80;
+        return count;
+    }
+
+    // Byte offset of the code point with the given index
+    static size_t utf8Offset(const std::string& text, uint32_t index) {
+        size_t pos = 0;
+        while (pos < text.size()) {
+            if ((static_cast<unsigned char>(text[pos]) & 0xC0) != 0x80 && index-- == 0) break;
+            pos++;
+        }
+        return pos;
+    }
+
+    static ItemId lastId(const Item* item) {
+        return {item->id.client, item->id.clock + item->length - 1};
+    }
+
+    Item* newItem() {
+        itemPool.emplace_back();
+        itemPool.back().sequence = nextSequence++;
+        return &itemPool.back();
+    }
+
+    uint32_t nextClock(uint32_t client) const {
+        auto it = clients.find(client);
+        if (it == clients.end() || it->second.empty()) return 0;
+        const Item* last = it->second.rbegin()->second;
+        return last->id.clock + last->length;
+    }
+
+    bool isKnown(const ItemId& id) const {
+        return id.clock < nextClock(id.client);
+    }
+
+    Item* findItem(const ItemId& id) const {
+        auto client = clients.find(id.client);
+        if (client == clients.end()) return nullptr;
+        auto it = client->second.upper_bound(id.clock);
+        if (it == client->second.begin()) return nullptr;
+        Item* item = (--it)->second;
+        return id.clock < item->id.clock + item->length ? item : nullptr;
+    }
+
+    /**
+     * Split item so that it keeps its first offset characters; the rest
+     * becomes a new item placed right after it. Returns the new item.
+     */
+    Item* splitItem(Item* item, uint32_t offset) {
+        Item* rest = newItem();
+        rest->id = {item->id.client, item->id.clock + offset};
+        rest->length = item->length - offset;
+        rest->originLeft = {item->id.client, item->id.clock + offset - 1};
+        rest->originRight = item->originRight;
+        rest->deleted = item->deleted;
+        rest->sequence = item->sequence;
+        if (!item->deleted) {
+            size_t split = utf8Offset(item->content, offset);
+            rest->content = item->content.substr(split);
+            item->content.resize(split);
+        }
+        item->length = offset;
+
+        rest->left = item;
+        rest->right = item->right;
+        if (item->right) item->right->left = rest;
+        item->right = rest;
+
+        Block* block = item->block;
+        auto pos = std::find(block->items.begin(), block->items.end(), item);
+        block->items.insert(pos + 1, rest);
+        rest->block = block;
+        if (block->items.size() > BLOCK_MAX) splitBlock(block);
+
+        clients[rest->id.client][rest->id.clock] = rest;
+        return rest;
+    }
+
+    // The item whose last character is id (splitting if needed)
+    Item* itemEndingAt(const ItemId& id) {
+        Item* item = findItem(id);
+        if (id.clock + 1 < item->id.clock + item->length) splitItem(item, id.clock - item->id.clock + 1);
+        return item;
+    }
+
+    // The item whose first character is id (splitting if needed)
+    Item* itemStartingAt(const ItemId& id) {
+        Item* item = findItem(id);
+        if (id.clock > item->id.clock) return splitItem(item, id.clock - item->id.clock);
+        return item;
+    }
+
+    void placeAfter(Item* left, Item* item) {
+        item->left = left;
+        item->right = left ? left->right : first;
+        if (item->right) item->right->left = item;
+        if (left) left->right = item;
+        else first = item;
+
+        Block* block;
+        size_t index = 0;
+        if (left) {
+            block = left->block;
+            index = std::find(block->items.begin(), block->items.end(), left) - block->items.begin() + 1;
+        } else {
+            if (blocks.empty()) blocks.push_back(std::unique_ptr<Block>(new Block()));
+            block = blocks.front().get();
+        }
+        block->items.insert(block->items.begin() + index, item);
+        item->block = block;
+        if (!item->deleted) {
+            block->visible += item->length;
+            visibleLength += item->length;
+        }
+        if (block->items.size() > BLOCK_MAX) splitBlock(block);
+    }
+
+    void splitBlock(Block* block) {
+        std::unique_ptr<Block> upper(new Block());
+        size_t half = block->items.size() / 2;
+        upper->items.assign(block->items.begin() + half, block->items.end());
+        block->items.resize(half);
+        for (Item* item : upper->items) {
+            item->block = upper.get();
+            if (!item->deleted) upper->visible += item->length;
+        }
+        block->visible -= upper->visible;
+
+        blocks.insert(blocks.begin() + block->index + 1, std::move(upper));
+        for (size_t i = block->index + 1; i < blocks.size(); i++) blocks[i]->index = i;
+    }
+
+    // Item holding the visible character at pos (< length()) and its offset
+    Item* locate(size_t pos, uint32_t& offset) const {
+        size_t b = 0;
+        while (pos >= blocks[b]->visible) pos -= blocks[b++]->visible;
+        for (Item* item : blocks[b]->items) {
+            if (item->deleted) continue;
+            if (pos < item->length) {
+                offset = static_cast<uint32_t>(pos);
+                return item;
+            }
+            pos -= item->length;
+        }
+        return nullptr;
+    }
+
+    void markDeleted(Item* item) {
+        if (item->deleted) return;
+        item->deleted = true;
+        item->block->visible -= item->length;
+        visibleLength -= item->length;
+        std::string().swap(item->content);
+    }
+
+    void deleteRange(ItemId id, uint32_t length) {
+        while (length > 0) {
+            Item* item = findItem(id);
+            uint32_t offset = id.clock - item->id.clock;
+            uint32_t span = std::min(length, item->length - offset);
+            if (!item->deleted) {
+                if (offset > 0) item = splitItem(item, offset);
+                if (item->length > span) splitItem(item, span);
+                markDeleted(item);
+            }
+            id.clock += span;
+            length -= span;
+        }
+    }
+
+    /**
+     * YATA integration of a remote item whose dependencies are present.
+     * Scans the items between its origins and skips past the concurrent
+     * inserts that must come before it.
+     */
+    void integrate(PendingItem& incoming) {
+        Item* left = incoming.originLeft.valid() ? itemEndingAt(incoming.originLeft) : nullptr;
+        Item* right = incoming.originRight.valid() ? itemStartingAt(incoming.originRight) : nullptr;
+
+        std::unordered_set<const Item*> conflicting;
+        std::unordered_set<const Item*> beforeOrigin;
+        for (Item* o = left ? left->right : first; o && o != right; o = o->right) {
+            beforeOrigin.insert(o);
+            conflicting.insert(o);
+            if (o->originLeft == incoming.originLeft) {
+                if (o->id.client < incoming.id.client) {
+                    left = o;
+                    conflicting.clear();
+                } else if (o->originRight == incoming.originRight) {
+                    break;
+                }
+            } else if (o->originLeft.valid() && beforeOrigin.count(findItem(o->originLeft))) {
+                if (!conflicting.count(findItem(o->originLeft))) {
+                    left = o;
+                    conflicting.clear();
+                }
+            } else {
+                break;
+            }
+        }
+
+        // Continuation of the left run: extend it instead of adding an item
+        if (left && left->id.client == incoming.id.client &&
+            left->id.clock + left->length == incoming.id.clock && left->deleted == incoming.deleted &&
+            incoming.originLeft == lastId(left) && incoming.originRight == left->originRight) {
+            left->length += incoming.length;
+            if (!left->deleted) {
+                left->content += incoming.content;
+                left->block->visible += incoming.length;
+                visibleLength += incoming.length;
+            }
+            return;
+        }
+
+        Item* item = newItem();
+        item->id = incoming.id;
+        item->length = incoming.length;
+        item->originLeft = incoming.originLeft;
+        item->originRight = incoming.originRight;
+        item->deleted = incoming.deleted;
+        item->content = std::move(incoming.content);
+        clients[item->id.client][item->id.clock] = item;
+        placeAfter(left, item);
+    }
+
+    // Integrate, skip or defer one pending item; true once it is consumed
+    bool tryIntegrate(PendingItem& pending) {
+        uint32_t known = nextClock(pending.id.client);
+        if (pending.id.clock + pending.length <= known) return true;
+        if (pending.id.clock > known) return false;
+
+        if (pending.id.clock < known) {
+            // Already have a prefix of this run; keep the tail
+            uint32_t offset = known - pending.id.clock;
+            pending.originLeft = {pending.id.client, known - 1};
+            if (!pending.deleted) pending.content.erase(0, utf8Offset(pending.content, offset));
+            pending.id.clock = known;
+            pending.length -= offset;
+        }
+        if (pending.originLeft.valid() && !isKnown(pending.originLeft)) return false;
+        if (pending.originRight.valid() && !isKnown(pending.originRight)) return false;
+
+        integrate(pending);
+        return true;
+    }
+
+    void drainPending() {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            size_t kept = 0;
+            for (size_t i = 0; i < pendingItems.size(); i++) {
+                if (tryIntegrate(pendingItems[i])) {
+                    progress = true;
+                } else {
+                    if (kept != i) pendingItems[kept] = std::move(pendingItems[i]);
+                    kept++;
+                }
+            }
+            pendingItems.resize(kept);
+        }
+
+        size_t kept = 0;
+        for (const auto& range : pendingDeletes) {
+            if (range.id.clock + range.length <= nextClock(range.id.client)) {
+                deleteRange(range.id, range.length);
+            } else {
+                pendingDeletes[kept++] = range;
+            }
+        }
+        pendingDeletes.resize(kept);
+    }
+};
+
+/**
+ * Coalescing buffer for high-frequency small updates (typing indicators,
+ * reactions, read receipts). Updates are keyed by (entity, field); a
+ * newer update replaces the pending one for its key, and everything
+ * pending goes out as one batch once the oldest has waited a window.
+ */
+class UpdateCoalescer {
+public:
+    struct Update {
+        int entity;
+        uint32_t field;
+        long long time;
+        std::string value;
+    };
+
+    // Past this many pending keys a batch is due regardless of the window
+    static constexpr size_t MAX_PENDING = 4096;
+
+    void setWindow(long long ms) { windowMs = std::max(0LL, ms); }
+
+    size_t size() const { return pending.size(); }
+
+    uint64_t supersededCount() const { return superseded; }
+
+    // True if the update replaced a pending one
+    bool queue(int entity, uint32_t field, const std::string& value, long long now) {
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(entity)) << 32) | field;
+        auto slot = index.find(key);
+        if (slot != index.end()) {
+            Update& update = pending[slot->second];
+            update.value = value;
+            update.time = now;
+            superseded++;
+            return true;
+        }
+        if (pending.empty()) oldest = now;
+        index.emplace(key, pending.size());
+        pending.push_back({entity, field, now, value});
+        return false;
+    }
+
+    bool due(long long now) const {
+        return !pending.empty() && (now - oldest >= windowMs || pending.size() >= MAX_PENDING);
+    }
+
+    /**
+     * Encode and clear everything pending, sorted by (entity, field):
+     *   varint count, svarint base time, then per update svarint entity
+     *   delta, varint field, varint time - base, varint length, value
+     */
+    void flush(SyncUtils::ByteWriter& out) {
+        std::sort(pending.begin(), pending.end(), [](const Update& a, const Update& b) {
+            return a.entity != b.entity ? a.entity < b.entity : a.field < b.field;
+        });
+        long long base = pending.empty() ? 0 : pending[0].time;
+        for (const Update& update : pending) base = std::min(base, update.time);
+
+        out.varint(pending.size());
+        out.svarint(base);
+        int64_t previous = 0;
+        for (const Update& update : pending) {
+            out.svarint(update.entity - previous);
+            previous = update.entity;
+            out.varint(update.field);
+            out.varint(static_cast<uint64_t>(update.time - base));
+            out.varint(update.value.size());
+            out.raw(update.value.data(), update.value.size());
+        }
+        clear();
+    }
+
+    static bool decode(SyncUtils::ByteReader& in, std::vector<Update>& updates) {
+        uint64_t count = in.varint();
+        long long base = in.svarint();
+        int64_t entity = 0;
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            entity += in.svarint();
+            Update update;
+            update.entity = static_cast<int>(entity);
+            update.field = static_cast<uint32_t>(in.varint());
+            update.time = base + static_cast<long long>(in.varint());
+            uint64_t length = in.varint();
+            const uint8_t* value = in.ok ? in.raw(length) : nullptr;
+            if (!value) return false;
+            update.value.assign(reinterpret_cast<const char*>(value), length);
+            updates.push_back(std::move(update));
+        }
+        return in.ok;
+    }
+
+    void clear() {
+        pending.clear();
+        index.clear();
+    }
+
+private:
+    std::vector<Update> pending;
+    std::unordered_map<uint64_t, size_t> index;     // (entity, field) -> pending slot
+    long long windowMs = 200;
+    long long oldest = 0;                           // queue time of the oldest pending key
+    uint64_t superseded = 0;
+};
+
+class SyncEngine {
+public:
+    // Record kinds of the streaming diff
+    static constexpr int DIFF_ADDED = 1;
+    static constexpr int DIFF_MODIFIED = 2;
+    static constexpr int DIFF_DELETED = 3;        // remote tombstone is newer than ours
+    static constexpr int DIFF_LOCAL_ONLY = 4;     // remote has no record of it yet
+    static constexpr int DIFF_LOCAL_DELETED = 5;  // our tombstone is newer than the remote copy
+
+    // Which message set a bulk operation targets
+    static constexpr int SIDE_LOCAL = 0;
+    static constexpr int SIDE_REMOTE = 1;
+
+    // calculateDiff() result: one ascending ID list per kind, at [kind - 1]
+    using DiffLists = std::array<std::vector<int>, 5>;
+
+    // Operation log entry kinds
+    static constexpr uint8_t OP_ADD = 1;
+    static constexpr uint8_t OP_EDIT = 2;
+    static constexpr uint8_t OP_DELETE = 3;
+
+private:
+    struct Message {
+        int id;
+        long long timestamp;
+        uint64_t hash;
+        uint64_t hlc = 0;       // HybridClock stamp of the last write
+        uint32_t origin = 0;    // node ID of the last writer
+        int conversation = 0;   // 0 = unassigned
+        std::string content;
+    };
+
+    /**
+     * Deletion record. Its clock lets a late write that predates the
+     * delete lose against it, and tells "deleted" apart from "not loaded".
+     */
+    struct Tombstone {
+        uint64_t hlc = 0;
+        uint32_t origin = 0;
+        uint64_t seq = 0;       // op log sequence of the delete (local side)
+        int conversation = 0;
+    };
+
+    using TombstoneMap = std::unordered_map<int, Tombstone>;
+
+    /**
+     * Flat message store: messages live in one dense row vector and an
+     * open-addressing table (linear probing, backward-shift deletion) maps
+     * IDs to rows, so lookups touch one or two cache lines instead of
+     * chasing node pointers. Erasing moves the last row into the hole.
+     * An (id, hash) column sorted by ID is rebuilt lazily for merge diffs.
+     */
+    class MessageStore {
+    public:
+        struct SortedEntry {
+            int id;
+            uint32_t row;
+            uint64_t hash;
+        };
+
+        size_t size() const { return rows.size(); }
+
+        std::vector<Message>::iterator begin() { return rows.begin(); }
+        std::vector<Message>::iterator end() { return rows.end(); }
+        std::vector<Message>::const_iterator begin() const { return rows.begin(); }
+        std::vector<Message>::const_iterator end() const { return rows.end(); }
+
+        Message* find(int id) {
+            size_t slot = findSlot(id);
+            return slot == NOT_FOUND ? nullptr : &rows[slots[slot] - 1];
+        }
+
+        const Message* find(int id) const {
+            return const_cast<MessageStore*>(this)->find(id);
+        }
+
+        const Message& at(uint32_t row) const { return rows[row]; }
+
+        /**
+         * Row for id, created (with only id set) if absent. The reference
+         * is invalidated by the next insert or erase.
+         */
+        Message& upsert(int id, bool& inserted) {
+            sortedValid = false;
+            mutations++;
+            Message* existing = find(id);
+            inserted = existing == nullptr;
+            if (existing) return *existing;
+
+            if ((rows.size() + 1) * 2 > slots.size()) rehash(std::max<size_t>(16, slots.size() * 2));
+            rows.emplace_back();
+            rows.back().id = id;
+            slots[emptySlotFor(id)] = static_cast<uint32_t>(rows.size());
+            return rows.back();
+        }
+
+        Message& upsert(int id) {
+            bool inserted;
+            return upsert(id, inserted);
+        }
+
+        bool erase(int id) {
+            size_t slot = findSlot(id);
+            if (slot == NOT_FOUND) return false;
+            sortedValid = false;
+            mutations++;
+
+            uint32_t row = slots[slot] - 1;
+            removeSlot(slot);
+            if (row + 1 != rows.size()) {
+                // Move the last row into the hole and repoint its slot
+                slots[findSlot(rows.back().id)] = row + 1;
+                rows[row] = std::move(rows.back());
+            }
+            rows.pop_back();
+            return true;
+        }
+
+        void reserve(size_t count) {
+            rows.reserve(count);
+            size_t wanted = 16;
+            while (wanted < count * 2) wanted *= 2;
+            if (wanted > slots.size()) rehash(wanted);
+        }
+
+        void clear() {
+            rows.clear();
+            slots.clear();
+            sorted.clear();
+            sortedValid = false;
+            mutations++;
+        }
+
+        // Bumped by every insert, update and erase
+        uint64_t generation() const { return mutations; }
+
+        /**
+         * All (id, row, hash) entries in ascending ID order
+         */
+        const std::vector<SortedEntry>& byId() const {
+            if (sortedValid) return sorted;
+            // Two-pass LSD radix sort on the ordered 32-bit key
+            std::vector<SortedEntry> scratch(rows.size());
+            for (size_t i = 0; i < rows.size(); i++) {
+                scratch[i] = {rows[i].id, static_cast<uint32_t>(i), rows[i].hash};
+            }
+            sorted.resize(rows.size());
+            std::vector<uint32_t> counts(1 << 16);
+            for (int shiftBits = 0; shiftBits < 32; shiftBits += 16) {
+                std::fill(counts.begin(), counts.end(), 0);
+                for (const auto& entry : scratch) counts[(SyncUtils::orderedKey(entry.id) >> shiftBits) & 0xFFFF]++;
+                uint32_t offset = 0;
+                for (auto& count : counts) {
+                    uint32_t bucket = count;
+                    count = offset;
+                    offset += bucket;
+                }
+                for (const auto& entry : scratch) {
+                    sorted[counts[(SyncUtils::orderedKey(entry.id) >> shiftBits) & 0xFFFF]++] = entry;
+                }
+                if (shiftBits == 0) scratch.swap(sorted);
+            }
+            sortedValid = true;
+            return sorted;
+        }
+
+    private:
+        static constexpr size_t NOT_FOUND = ~size_t(0);
+
+        std::vector<Message> rows;
+        std::vector<uint32_t> slots;    // row + 1, 0 = empty
+        int shift = 32;
+        mutable std::vector<SortedEntry> sorted;
+        mutable bool sortedValid = false;
+        uint64_t mutations = 0;
+
+        size_t home(int id) const {
+            return (static_cast<uint32_t>(id) * 0x9E3779B1u) >> shift;
+        }
+
+        size_t findSlot(int id) const {
+            if (slots.empty()) return NOT_FOUND;
+            const size_t mask = slots.size() - 1;
+            for (size_t i = home(id);; i = (i + 1) & mask) {
+                if (slots[i] == 0) return NOT_FOUND;
+                if (rows[slots[i] - 1].id == id) return i;
+            }
+        }
+
+        size_t emptySlotFor(int id) const {
+            const size_t mask = slots.size() - 1;
+            size_t i = home(id);
+            while (slots[i] != 0) i = (i + 1) & mask;
+            return i;
+        }
+
+        void removeSlot(size_t hole) {
+            const size_t mask = slots.size() - 1;
+            slots[hole] = 0;
+            for (size_t i = (hole + 1) & mask; slots[i] != 0; i = (i + 1) & mask) {
+                // Shift back entries whose probe path crosses the hole
+                size_t want = home(rows[slots[i] - 1].id);
+                if (((i - want) & mask) >= ((i - hole) & mask)) {
+                    slots[hole] = slots[i];
+                    slots[i] = 0;
+                    hole = i;
+                }
+            }
+        }
+
+        void rehash(size_t capacity) {
+            int bits = 0;
+            while ((size_t(1) << bits) < capacity) bits++;
+            shift = 32 - bits;
+            slots.assign(size_t(1) << bits, 0);
+            for (size_t row = 0; row < rows.size(); row++) {
+                slots[emptySlotFor(rows[row].id)] = static_cast<uint32_t>(row + 1);
+            }
+        }
+    };
+
+    // The shared store every peer syncs against. remoteMessages is a
+    // staging area for one remote snapshot (diffs, deltas, conflicts);
+    // peer-to-peer sync goes through PeerState instead.
+    MessageStore localMessages;
+    MessageStore remoteMessages;
+
+    // A live message and a tombstone for the same ID never coexist on one side
+    TombstoneMap localTombstones;
+    TombstoneMap remoteTombstones;
+
+    // Newest HLC stamp seen per origin node
+    using VersionVector = std::unordered_map<uint32_t, uint64_t>;
+
+    // One pending change of a priority sync, with its sort keys
+    struct PlannedChange {
+        int id;
+        int conversation;
+        int priority;
+        long long recency;              // time of the change
+        long long conversationRecency;  // newest change in its conversation
+    };
+
+    /**
+     * Changes past a peer's acknowledged cursor, drained in priority
+     * order by nextSyncBatch(). Only the last batch carries the cursor,
+     * since earlier ones do not cover a prefix of the log.
+     */
+    struct SyncPlan {
+        std::vector<PlannedChange> changes;
+        size_t next = 0;
+        uint64_t cursor = 0;            // log position the plan covers
+        uint64_t priorityVersion = 0;   // priorities the order was built for
+        bool resync = false;            // the log no longer reaches the peer
+        bool active = false;
+    };
+
+    /**
+     * What we know about one peer replica. A local tombstone is dropped
+     * once every peer's ackedCursor has passed its delete.
+     */
+    struct PeerState {
+        uint64_t ackedCursor = 0;   // our log, applied by the peer
+        uint64_t peerCursor = 0;    // the peer's log, applied by us
+        VersionVector seen;         // writes the peer is known to have
+        SyncPlan plan;
+    };
+
+    std::unordered_map<uint32_t, PeerState> peers;
+
+    // Newest stamp per origin over everything in the local store
+    VersionVector versionVector;
+
+    // Sync priority per conversation (absent = 0); higher drains first
+    std::unordered_map<int, int> conversationPriorities;
+    uint64_t priorityVersion = 0;
+
+    static void advance(VersionVector& vector, uint32_t origin, uint64_t hlc) {
+        uint64_t& newest = vector[origin];
+        newest = std::max(newest, hlc);
+    }
+
+    // Origin 0 marks writes stamped from wall time (imports, history),
+    // which no replica forwards in stamp order, so nothing covers them
+    static bool covers(const VersionVector& vector, uint32_t origin, uint64_t hlc) {
+        if (origin == 0) return false;
+        auto it = vector.find(origin);
+        return it != vector.end() && it->second >= hlc;
+    }
+
+    // How one ID currently compares across the two stores
+    enum class PairState : uint8_t {
+        ABSENT, LOCAL_ONLY, REMOTE_ONLY, SAME, CONFLICT, REMOTE_DELETED, LOCAL_DELETED
+    };
+
+    // Diff counters kept current on every store mutation for O(1) stats
+    size_t addedCount = 0;          // remote only
+    size_t deletedCount = 0;        // local, deleted remotely since
+    size_t conflictCount = 0;       // both, content differs
+    size_t localOnlyCount = 0;      // local, unknown to the remote
+    size_t localDeletedCount = 0;   // remote, deleted locally since
+
+    // Deletes win ties so that a delete and a write stamped alike converge
+    static bool deletedAfter(const Tombstone& tombstone, const Message& msg) {
+        if (tombstone.hlc != msg.hlc) return tombstone.hlc > msg.hlc;
+        return tombstone.origin >= msg.origin;
+    }
+
+    static bool supersededBy(const TombstoneMap& tombstones, const Message& msg) {
+        if (tombstones.empty()) return false;
+        auto it = tombstones.find(msg.id);
+        return it != tombstones.end() && deletedAfter(it->second, msg);
+    }
+
+    PairState classify(int id) const {
+        const Message* local = localMessages.find(id);
+        const Message* remote = remoteMessages.find(id);
+        if (local && remote) return local->hash == remote->hash ? PairState::SAME : PairState::CONFLICT;
+        if (local) return supersededBy(remoteTombstones, *local) ? PairState::REMOTE_DELETED : PairState::LOCAL_ONLY;
+        if (remote) return supersededBy(localTombstones, *remote) ? PairState::LOCAL_DELETED : PairState::REMOTE_ONLY;
+        return PairState::ABSENT;
+    }
+
+    size_t* counterFor(PairState state) {
+        switch (state) {
+            case PairState::REMOTE_ONLY: return &addedCount;
+            case PairState::REMOTE_DELETED: return &deletedCount;
+            case PairState::CONFLICT: return &conflictCount;
+            case PairState::LOCAL_ONLY: return &localOnlyCount;
+            case PairState::LOCAL_DELETED: return &localDeletedCount;
+            default: return nullptr;
+        }
+    }
+
+    void recount(PairState before, PairState after) {
+        if (before == after) return;
+        if (size_t* counter = counterFor(before)) (*counter)--;
+        if (size_t* counter = counterFor(after)) (*counter)++;
+    }
+
+    /**
+     * Merge the ID-sorted columns of both stores. Each list comes out in
+     * ascending ID order; any of them may be null.
+     */
+    void diffStores(std::vector<int>* added, std::vector<int>* modified, std::vector<int>* deleted) const {
+        size_t i = 0, j = 0;
+        mergeDiff(i, j, SIZE_MAX, [&](int kind, int id) {
+            std::vector<int>* list = kind == DIFF_ADDED ? added : kind == DIFF_MODIFIED ? modified :
+                                     kind == DIFF_DELETED ? deleted : nullptr;
+            if (list) list->push_back(id);
+        });
+    }
+
+    /**
+     * Step the merge from sorted positions (i, j), calling emit(kind, id)
+     * for up to limit differences. Returns how many were emitted. IDs on
+     * one side only are checked against the other side's tombstones.
+     */
+    template <typename Emit>
+    size_t mergeDiff(size_t& i, size_t& j, size_t limit, Emit&& emit) const {
+        const auto& local = localMessages.byId();
+        const auto& remote = remoteMessages.byId();
+        size_t emitted = 0;
+        while (emitted < limit && (i < local.size() || j < remote.size())) {
+            if (j == remote.size() || (i < local.size() && local[i].id < remote[j].id)) {
+                // Skip the row fetch while there are no tombstones to check
+                bool deleted = !remoteTombstones.empty() &&
+                               supersededBy(remoteTombstones, localMessages.at(local[i].row));
+                emit(deleted ? DIFF_DELETED : DIFF_LOCAL_ONLY, local[i++].id);
+                emitted++;
+            } else if (i == local.size() || remote[j].id < local[i].id) {
+                bool deleted = !localTombstones.empty() &&
+                               supersededBy(localTombstones, remoteMessages.at(remote[j].row));
+                emit(deleted ? DIFF_LOCAL_DELETED : DIFF_ADDED, remote[j++].id);
+                emitted++;
+            } else {
+                if (local[i].hash != remote[j].hash) {
+                    emit(DIFF_MODIFIED, local[i].id);
+                    emitted++;
+                }
+                i++;
+                j++;
+            }
+        }
+        return emitted;
+    }
+
+    // Streaming diff state (beginDiff / nextDiffChunk)
+    struct DiffCursor {
+        size_t localPos = 0;
+        size_t remotePos = 0;
+        bool started = false;       // lastId is valid
+        int lastId = 0;
+        uint64_t generation = 0;    // store generations the positions belong to
+        size_t chunkRecords = 0;
+        std::vector<int32_t> chunk; // (kind, id) pairs
+    };
+
+    DiffCursor diffCursor;
+
+    uint64_t storeGeneration() const {
+        return localMessages.generation() + remoteMessages.generation();
+    }
+
+    static constexpr size_t DEFAULT_DIFF_CHUNK = 4096;
+
+    HybridClock clock;
+    uint32_t nodeId = 0;
+
+    // Collaboratively edited texts, keyed by document (message) ID
+    std::unordered_map<int, std::unique_ptr<TextDocument>> documents;
+
+    TextDocument& document(int docId) {
+        std::unique_ptr<TextDocument>& slot = documents[docId];
+        if (!slot) slot.reset(new TextDocument());
+        return *slot;
+    }
+
+    // Hash tree over localMessages for replica-to-replica reconciliation
+    MerkleTree localTree;
+    StrataEstimator localStrata;
+    bool treeStale = false;     // after deserialize(): rebuilt on first use
+
+    // Match-finder scratch reused across delta encodes
+    DeltaCodec deltaCodec;
+
+    // Ephemeral updates waiting for their coalescing window
+    UpdateCoalescer coalescer;
+
+    // Compression of outgoing batches (and the shared dictionary)
+    BlockCompressor compressor;
+    bool compressionEnabled = true;
+
+    // Reconciliation wire format
+    static constexpr uint8_t TAG_RANGE_QUERY = 0x51;
+    static constexpr uint8_t TAG_RANGE_REPLY = 0x52;
+    static constexpr uint8_t TAG_STRATA = 0x53;
+    static constexpr uint8_t TAG_IBLT = 0x54;
+    static constexpr uint8_t TAG_DELTA_BATCH = 0x55;
+    static constexpr uint8_t TAG_CHANGES = 0x56;
+    static constexpr uint8_t TAG_STATE_VECTOR = 0x57;
+    static constexpr uint8_t TAG_TEXT_UPDATE = 0x58;
+    static constexpr uint8_t TAG_COMPRESSED = 0x59;
+    static constexpr uint8_t TAG_VERSION_VECTOR = 0x5A;
+    static constexpr uint8_t TAG_UPDATES = 0x5B;
+    static constexpr uint8_t TAG_SNAPSHOT = 0x5C;
+
+    // Bump on any change to the serialize() layout
+    static constexpr uint8_t SNAPSHOT_VERSION = 1;
+    static constexpr uint8_t SNAPSHOT_COMPRESSION = 0x01;
+
+    // Compressed wrapper: u8 TAG_COMPRESSED, u8 flags, [u32 dictionary ID],
+    // varint raw length, block. Payloads below the threshold, or that do
+    // not shrink, are sent as is.
+    static constexpr uint8_t COMPRESSED_WITH_DICTIONARY = 0x01;
+    static constexpr size_t COMPRESS_MIN_BYTES = 64;
+    static constexpr size_t DICTIONARY_SAMPLE_BYTES = 256 * 1024;
+
+    // Change batch flags
+    static constexpr uint8_t CHANGES_FULL_RESYNC = 0x01;
+
+    /**
+     * Append-only log of local changes. Sequence numbers are strictly
+     * increasing; compaction keeps only the newest entry per ID, which is
+     * all changesSince() needs, so cursors stay valid. Delete entries
+     * beyond LOG_DELETE_RETENTION are dropped oldest first and logFloor
+     * records the newest dropped sequence: cursors below it must resync.
+     */
+    struct LogEntry {
+        uint64_t seq;
+        int id;
+        uint8_t op;
+    };
+
+    std::vector<LogEntry> opLog;
+    uint64_t nextSeq = 1;
+    uint64_t logFloor = 0;
+
+    static constexpr size_t LOG_COMPACT_SLACK = 1024;
+    static constexpr size_t LOG_DELETE_RETENTION = 4096;
+
+    // IBLT cells per estimated difference; decoding succeeds with high
+    // probability at ~1.5x, the rest absorbs estimator error
+    static constexpr size_t IBLT_CELLS_PER_DIFF = 2;
+    static constexpr size_t IBLT_MIN_CELLS = 24;
+
+    static constexpr uint64_t TOMBSTONE_SALT = 0x7F4A7C15D1B54A33ULL;
+
+    // Ranges this small are answered with their (id, leaf hash) list
+    static constexpr uint32_t LEAF_LIST_MAX = 16;
+
+    // Bulk load layout: u32 count, count x BATCH_RECORD_SIZE records of
+    // (i32 id, i64 timestamp, u32 content offset, u32 content length),
+    // then the content arena. All little-endian; offsets are arena-relative.
+    static constexpr size_t BATCH_HEADER_SIZE = 4;
+    static constexpr size_t BATCH_RECORD_SIZE = 20;
+
+    struct RangeQuery {
+        int level;
+        uint32_t prefix;
+    };
+
+    // Initiator-side state of an in-flight reconciliation
+    std::vector<RangeQuery> pendingQueries;
+    std::vector<int> reconcileAdded;
+    std::vector<int> reconcileModified;
+    std::vector<int> reconcileDeleted;
+
+    // Content hash for change detection; equal hashes mean equal content
+    uint64_t hashMessage(const std::string& content) const {
+        return SyncUtils::hash64(content.data(), content.size());
+    }
+
+    // Leaf hash binds the ID to the content hash so moved content differs
+    uint64_t leafHash(int id, uint64_t hash) const {
+        return SyncUtils::mix64(hash ^ SyncUtils::mix64(static_cast<uint32_t>(id) + SyncUtils::PRIME64_3));
+    }
+
+    // Tombstones are leaves too, so reconciliation carries deletes; the
+    // salt keeps a tombstone leaf apart from any content leaf
+    uint64_t tombstoneLeaf(int id, const Tombstone& tombstone) const {
+        return leafHash(id, SyncUtils::mix64(tombstone.hlc ^ TOMBSTONE_SALT) + tombstone.origin);
+    }
+
+    // Leaf of id in the local set (live message or tombstone)
+    bool localLeaf(int id, uint64_t& leaf) const {
+        if (const Message* msg = localMessages.find(id)) {
+            leaf = leafHash(id, msg->hash);
+            return true;
+        }
+        auto it = localTombstones.find(id);
+        if (it == localTombstones.end()) return false;
+        leaf = tombstoneLeaf(id, it->second);
+        return true;
+    }
+
+    void addLeaf(int id, uint64_t leaf) {
+        if (treeStale) return;
+        localTree.add(SyncUtils::orderedKey(id), leaf);
+        localStrata.insert(SyncUtils::orderedKey(id), leaf);
+    }
+
+    void removeLeaf(int id, uint64_t leaf) {
+        if (treeStale) return;
+        localTree.remove(SyncUtils::orderedKey(id), leaf);
+        localStrata.insert(SyncUtils::orderedKey(id), leaf, -1);
+    }
+
+    /**
+     * Write msg to the local store. False if nothing changed or the
+     * message was deleted after msg was written.
+     */
+    bool storeLocal(const Message& msg) {
+        const Message* existing = localMessages.find(msg.id);
+        auto tombstone = localTombstones.find(msg.id);
+        if (existing) {
+            if (existing->hash == msg.hash && existing->timestamp == msg.timestamp) return false;
+            removeLeaf(msg.id, leafHash(msg.id, existing->hash));
+        } else if (tombstone != localTombstones.end()) {
+            if (deletedAfter(tombstone->second, msg)) return false;
+            removeLeaf(msg.id, tombstoneLeaf(msg.id, tombstone->second));
+        }
+        addLeaf(msg.id, leafHash(msg.id, msg.hash));
+        appendLog(msg.id, existing ? OP_EDIT : OP_ADD);
+        PairState before = classify(msg.id);
+        int conversation = msg.conversation;
+        if (tombstone != localTombstones.end()) {
+            if (!conversation) conversation = tombstone->second.conversation;
+            localTombstones.erase(tombstone);
+        }
+        Message& row = localMessages.upsert(msg.id);
+        // An unassigned write keeps the conversation already on record
+        if (!conversation) conversation = row.conversation;
+        row = msg;
+        row.conversation = conversation;
+        advance(versionVector, msg.origin, msg.hlc);
+        recount(before, classify(msg.id));
+        return true;
+    }
+
+    // Takes msg's contents; msg is left holding the replaced row
+    void storeRemote(Message& msg) {
+        PairState before = classify(msg.id);
+        remoteTombstones.erase(msg.id);
+        std::swap(remoteMessages.upsert(msg.id), msg);
+        recount(before, classify(msg.id));
+    }
+
+    /**
+     * Delete id locally as of the given clock. Ignored if the current
+     * version (or an existing tombstone) is newer. Deleting an ID we have
+     * never seen still leaves a tombstone, so a late add cannot revive it.
+     */
+    bool removeLocal(int id, uint64_t hlc, uint32_t origin, int conversation = 0) {
+        Tombstone tombstone;
+        tombstone.hlc = hlc;
+        tombstone.origin = origin;
+        tombstone.conversation = conversation;
+
+        const Message* existing = localMessages.find(id);
+        auto previous = localTombstones.find(id);
+        if (existing) {
+            if (!deletedAfter(tombstone, *existing)) return false;
+            removeLeaf(id, leafHash(id, existing->hash));
+        } else if (previous != localTombstones.end()) {
+            const Tombstone& old = previous->second;
+            if (old.hlc > hlc || (old.hlc == hlc && old.origin >= origin)) return false;
+            removeLeaf(id, tombstoneLeaf(id, old));
+        }
+
+        if (!tombstone.conversation) {
+            if (existing) tombstone.conversation = existing->conversation;
+            else if (previous != localTombstones.end()) tombstone.conversation = previous->second.conversation;
+        }
+
+        PairState before = classify(id);
+        localMessages.erase(id);
+        tombstone.seq = nextSeq;
+        localTombstones[id] = tombstone;
+        advance(versionVector, origin, hlc);
+        addLeaf(id, tombstoneLeaf(id, tombstone));
+        recount(before, classify(id));
+        appendLog(id, OP_DELETE);
+        return true;
+    }
+
+    /**
+     * One change record: u8 op, svarint id, svarint conversation, then for
+     * a delete varint hlc, varint origin, otherwise svarint timestamp,
+     * varint hlc, varint origin, varint length, content bytes. False if
+     * id has neither a message nor a tombstone, or known already covers
+     * it (nothing is written).
+     */
+    bool writeChange(SyncUtils::ByteWriter& out, int id, uint8_t op,
+                     const VersionVector* known = nullptr) const {
+        const Message* msg = localMessages.find(id);
+        if (msg && op != OP_DELETE) {
+            if (known && covers(*known, msg->origin, msg->hlc)) return false;
+            out.u8(op);
+            out.svarint(id);
+            out.svarint(msg->conversation);
+            out.svarint(msg->timestamp);
+            out.varint(msg->hlc);
+            out.varint(msg->origin);
+            out.varint(msg->content.size());
+            out.raw(msg->content.data(), msg->content.size());
+            return true;
+        }
+        auto it = localTombstones.find(id);
+        if (it == localTombstones.end()) return false;
+        if (known && covers(*known, it->second.origin, it->second.hlc)) return false;
+        out.u8(OP_DELETE);
+        out.svarint(id);
+        out.svarint(it->second.conversation);
+        out.varint(it->second.hlc);
+        out.varint(it->second.origin);
+        return true;
+    }
+
+    // Newest log entry per ID after cursor, in sequence order
+    void collectChanges(uint64_t cursor, std::vector<const LogEntry*>& changes) const {
+        auto first = std::upper_bound(opLog.begin(), opLog.end(), cursor,
+            [](uint64_t value, const LogEntry& entry) { return value < entry.seq; });
+
+        // Walk backwards so the first entry seen per ID is the newest
+        std::unordered_set<int> seen;
+        for (auto it = opLog.end(); it != first;) {
+            --it;
+            if (seen.insert(it->id).second) changes.push_back(&*it);
+        }
+        std::reverse(changes.begin(), changes.end());
+    }
+
+    /**
+     * Sort the undrained part of a plan: conversations by priority, then
+     * by their newest change; changes within a conversation newest first
+     */
+    void orderPlan(SyncPlan& plan) const {
+        auto first = plan.changes.begin() + plan.next;
+        std::unordered_map<int, long long> newest;
+        for (auto it = first; it != plan.changes.end(); ++it) {
+            auto priority = conversationPriorities.find(it->conversation);
+            it->priority = priority == conversationPriorities.end() ? 0 : priority->second;
+            auto slot = newest.emplace(it->conversation, it->recency);
+            if (!slot.second) slot.first->second = std::max(slot.first->second, it->recency);
+        }
+        for (auto it = first; it != plan.changes.end(); ++it) {
+            it->conversationRecency = newest[it->conversation];
+        }
+        std::sort(first, plan.changes.end(), [](const PlannedChange& a, const PlannedChange& b) {
+            if (a.priority != b.priority) return a.priority > b.priority;
+            if (a.conversationRecency != b.conversationRecency) return a.conversationRecency > b.conversationRecency;
+            if (a.conversation != b.conversation) return a.conversation < b.conversation;
+            if (a.recency != b.recency) return a.recency > b.recency;
+            return a.id < b.id;
+        });
+        plan.priorityVersion = priorityVersion;
+    }
+
+    // changesSince(), leaving out records that known already covers
+    std::vector<uint8_t> encodeChangesSince(uint64_t cursor, const VersionVector* known) {
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_CHANGES);
+
+        if (cursor < logFloor || cursor > getCursor()) {
+            out.u8(CHANGES_FULL_RESYNC);
+            out.varint(getCursor());
+            out.varint(0);
+            return out.bytes;
+        }
+
+        std::vector<const LogEntry*> changes;
+        collectChanges(cursor, changes);
+
+        SyncUtils::ByteWriter records;
+        size_t count = 0;
+        for (const LogEntry* entry : changes) {
+            if (writeChange(records, entry->id, entry->op, known)) count++;
+        }
+        out.u8(0);
+        out.varint(getCursor());
+        out.varint(count);
+        out.raw(records.bytes.data(), records.bytes.size());
+        return packPayload(std::move(out.bytes));
+    }
+
+    // applyChanges(), noting every record's stamp in sender if given
+    int applyChangeBatch(const std::string& buffer, uint64_t& cursor, bool& fullResync,
+                         VersionVector* sender) {
+        std::string storage;
+        const std::string* payload;
+        if (!unpackPayload(buffer, storage, payload)) return -1;
+        SyncUtils::ByteReader in(*payload);
+        if (in.u8() != TAG_CHANGES) return -1;
+        uint8_t flags = in.u8();
+        uint64_t batchCursor = in.varint();
+        uint64_t count = in.varint();
+        if (!in.ok) return -1;
+
+        int applied = 0;
+        Message msg;
+        for (uint64_t i = 0; i < count; i++) {
+            uint8_t op = in.u8();
+            int id = static_cast<int>(in.svarint());
+            int conversation = static_cast<int>(in.svarint());
+            if (!in.ok) return -1;
+
+            if (op == OP_DELETE) {
+                uint64_t hlc = in.varint();
+                uint32_t origin = static_cast<uint32_t>(in.varint());
+                if (!in.ok) return -1;
+                clock.observe(hlc);
+                if (sender) advance(*sender, origin, hlc);
+                if (removeLocal(id, hlc, origin, conversation)) applied++;
+                continue;
+            }
+            if (op != OP_ADD && op != OP_EDIT) return -1;
+
+            msg.id = id;
+            msg.conversation = conversation;
+            msg.timestamp = in.svarint();
+            msg.hlc = in.varint();
+            msg.origin = static_cast<uint32_t>(in.varint());
+            uint64_t length = in.varint();
+            const uint8_t* content = in.ok ? in.raw(length) : nullptr;
+            if (!content) return -1;
+            msg.content.assign(reinterpret_cast<const char*>(content), length);
+            msg.hash = hashMessage(msg.content);
+            clock.observe(msg.hlc);
+            if (sender) advance(*sender, msg.origin, msg.hlc);
+            // Writes reach us from several peers: the newest stamp wins
+            const Message* existing = localMessages.find(id);
+            if (existing && !newerThan(msg, *existing)) continue;
+            if (storeLocal(msg)) applied++;
+        }
+
+        cursor = batchCursor;
+        fullResync = (flags & CHANGES_FULL_RESYNC) != 0;
+        return applied;
+    }
+
+    void appendLog(int id, uint8_t op) {
+        opLog.push_back({nextSeq++, id, op});
+        if (opLog.size() > 2 * localMessages.size() + LOG_COMPACT_SLACK) compactLog();
+    }
+
+    void compactLog() {
+        // Keep the newest entry per ID, preserving sequence order
+        std::unordered_map<int, uint64_t> newest;
+        newest.reserve(opLog.size());
+        for (const auto& entry : opLog) newest[entry.id] = entry.seq;
+
+        size_t deletes = 0;
+        size_t kept = 0;
+        for (const auto& entry : opLog) {
+            if (newest[entry.id] != entry.seq) continue;
+            if (entry.op == OP_DELETE) deletes++;
+            opLog[kept++] = entry;
+        }
+        opLog.resize(kept);
+
+        if (deletes <= LOG_DELETE_RETENTION) return;
+        size_t drop = deletes - LOG_DELETE_RETENTION;
+        kept = 0;
+        for (const auto& entry : opLog) {
+            if (drop > 0 && entry.op == OP_DELETE) {
+                logFloor = entry.seq;
+                drop--;
+                continue;
+            }
+            opLog[kept++] = entry;
+        }
+        opLog.resize(kept);
+    }
+
+    /**
+     * Visit (id, leaf hash) for every local message inside a tree node's range
+     */
+    template <typename Visitor>
+    void forEachLocalLeaf(int level, uint32_t prefix, Visitor& visit) const {
+        if (level == MerkleTree::LEAF_LEVEL) {
+            int id = SyncUtils::keyToId(prefix);
+            uint64_t leaf;
+            if (localLeaf(id, leaf)) visit(id, leaf);
+            return;
+        }
+        if (localTree.node(level, prefix).count == 0) return;
+        for (uint32_t child = 0; child < MerkleTree::FANOUT; child++) {
+            forEachLocalLeaf(level + 1, (prefix << MerkleTree::FANOUT_BITS) | child, visit);
+        }
+    }
+
+    MerkleTree::Node localNode(int level, uint32_t prefix) const {
+        if (level < MerkleTree::LEAF_LEVEL) return localTree.node(level, prefix);
+
+        MerkleTree::Node node;
+        if (localLeaf(SyncUtils::keyToId(prefix), node.hash)) node.count = 1;
+        return node;
+    }
+
+    void insertLocalLeaves(InvertibleBloomTable& table) const {
+        for (const Message& msg : localMessages) {
+            table.insert(SyncUtils::orderedKey(msg.id), leafHash(msg.id, msg.hash));
+        }
+        for (const auto& entry : localTombstones) {
+            table.insert(SyncUtils::orderedKey(entry.first), tombstoneLeaf(entry.first, entry.second));
+        }
+    }
+
+    // Compare a remote leaf list against the local leaves of the same range
+    void diffLeafRange(int level, uint32_t prefix,
+                       std::vector<std::pair<int, uint64_t>>& remoteLeaves) {
+        std::vector<std::pair<int, uint64_t>> localLeaves;
+        auto collect = [&](int id, uint64_t hash) { localLeaves.push_back({id, hash}); };
+        forEachLocalLeaf(level, prefix, collect);
+
+        std::sort(localLeaves.begin(), localLeaves.end());
+        std::sort(remoteLeaves.begin(), remoteLeaves.end());
+
+        size_t l = 0, r = 0;
+        while (l < localLeaves.size() || r < remoteLeaves.size()) {
+            if (r == remoteLeaves.size() ||
+                (l < localLeaves.size() && localLeaves[l].first < remoteLeaves[r].first)) {
+                reconcileDeleted.push_back(localLeaves[l++].first);
+            } else if (l == localLeaves.size() || remoteLeaves[r].first < localLeaves[l].first) {
+                reconcileAdded.push_back(remoteLeaves[r++].first);
+            } else {
+                if (localLeaves[l].second != remoteLeaves[r].second) {
+                    reconcileModified.push_back(localLeaves[l].first);
+                }
+                l++;
+                r++;
+            }
+        }
+    }
+
+    std::vector<uint8_t> encodeQueries() const {
+        SyncUtils::ByteWriter out;
+        if (pendingQueries.empty()) return out.bytes;
+        out.u8(TAG_RANGE_QUERY);
+        out.varint(pendingQueries.size());
+        for (const auto& query : pendingQueries) {
+            out.u8(static_cast<uint8_t>(query.level));
+            out.varint(query.prefix);
+        }
+        return out.bytes;
+    }
+
+    // Last-writer-wins order: HLC stamp, then writer node, then content
+    // hash so that every replica picks the same winner
+    static bool newerThan(const Message& a, const Message& b) {
+        if (a.hlc != b.hlc) return a.hlc > b.hlc;
+        if (a.origin != b.origin) return a.origin > b.origin;
+        return a.hash > b.hash;
+    }
+
+    // Messages that arrive without a clock get one derived from wall time
+    static void stampFromWall(Message& msg) {
+        msg.hlc = HybridClock::fromWall(msg.timestamp);
+        msg.origin = 0;
+    }
+
+    // Edits tick the clock. The first write of an ID dated before the
+    // clock is history being loaded, not a new edit, so it keeps its wall
+    // time and last-writer-wins does not depend on load order.
+    void stampLocal(Message& msg) {
+        if (HybridClock::fromWall(msg.timestamp) < clock.now() && !localMessages.find(msg.id)) {
+            stampFromWall(msg);
+            return;
+        }
+        msg.hlc = clock.tick(msg.timestamp);
+        msg.origin = nodeId;
+    }
+
+    std::vector<uint8_t> compressWrapped(const uint8_t* data, size_t size) {
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_COMPRESSED);
+        uint32_t dictId = compressor.dictionaryId();
+        out.u8(dictId ? COMPRESSED_WITH_DICTIONARY : 0);
+        if (dictId) out.u32(dictId);
+        out.varint(size);
+        compressor.compress(data, size, out.bytes);
+        return out.bytes;
+    }
+
+    std::vector<uint8_t> packPayload(std::vector<uint8_t> raw) {
+        if (!compressionEnabled || raw.size() < COMPRESS_MIN_BYTES) return raw;
+        std::vector<uint8_t> packed = compressWrapped(raw.data(), raw.size());
+        return packed.size() < raw.size() ? packed : raw;
+    }
+
+    /**
+     * Undo packPayload. payload points at buffer itself or, for
+     * compressed input, at storage. False if the wrapper is malformed or
+     * needs a dictionary other than ours.
+     */
+    bool unpackPayload(const std::string& buffer, std::string& storage, const std::string*& payload) const {
+        payload = &buffer;
+        if (buffer.empty() || static_cast<uint8_t>(buffer[0]) != TAG_COMPRESSED) return true;
+
+        SyncUtils::ByteReader in(buffer);
+        in.u8();
+        uint8_t flags = in.u8();
+        if ((flags & COMPRESSED_WITH_DICTIONARY) && in.u32() != compressor.dictionaryId()) return false;
+        uint64_t rawSize = in.varint();
+        // A 4-bit token plus one 255-run byte yields at most ~255 bytes
+        if (!in.ok || rawSize > in.remaining() * 255 + COMPRESS_MIN_BYTES) return false;
+
+        size_t blockSize = in.remaining();
+        const uint8_t* block = in.raw(blockSize);
+        if (!compressor.decompress(block, blockSize, rawSize, storage)) return false;
+        payload = &storage;
+        return true;
+    }
+
+    // Snapshot sections. IDs go out sorted and delta-coded.
+    static void writeStore(SyncUtils::ByteWriter& out, const MessageStore& store) {
+        const auto& sorted = store.byId();
+        out.varint(sorted.size());
+        int64_t previous = 0;
+        for (const auto& entry : sorted) {
+            const Message& msg = store.at(entry.row);
+            out.svarint(msg.id - previous);
+            previous = msg.id;
+            out.svarint(msg.timestamp);
+            out.u64(msg.hash);
+            out.varint(msg.hlc);
+            out.varint(msg.origin);
+            out.svarint(msg.conversation);
+            out.varint(msg.content.size());
+            out.raw(msg.content.data(), msg.content.size());
+        }
+    }
+
+    static bool readStore(SyncUtils::ByteReader& in, MessageStore& store) {
+        uint64_t count = in.varint();
+        if (!in.ok || count > in.remaining()) return false;
+        store.reserve(count);
+        int64_t id = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            id += in.svarint();
+            bool inserted;
+            Message& msg = store.upsert(static_cast<int>(id), inserted);
+            msg.timestamp = in.svarint();
+            msg.hash = in.u64();
+            msg.hlc = in.varint();
+            msg.origin = static_cast<uint32_t>(in.varint());
+            msg.conversation = static_cast<int>(in.svarint());
+            uint64_t length = in.varint();
+            const uint8_t* content = in.ok ? in.raw(length) : nullptr;
+            if (!content || !inserted) return false;
+            msg.content.assign(reinterpret_cast<const char*>(content), length);
+        }
+        return true;
+    }
+
+    static void writeTombstones(SyncUtils::ByteWriter& out, const TombstoneMap& tombstones) {
+        std::vector<int> ids;
+        ids.reserve(tombstones.size());
+        for (const auto& entry : tombstones) ids.push_back(entry.first);
+        std::sort(ids.begin(), ids.end());
+        out.varint(ids.size());
+        int64_t previous = 0;
+        for (int id : ids) {
+            const Tombstone& tombstone = tombstones.at(id);
+            out.svarint(id - previous);
+            previous = id;
+            out.varint(tombstone.hlc);
+            out.varint(tombstone.origin);
+            out.varint(tombstone.seq);
+            out.svarint(tombstone.conversation);
+        }
+    }
+
+    static bool readTombstones(SyncUtils::ByteReader& in, TombstoneMap& tombstones) {
+        uint64_t count = in.varint();
+        if (!in.ok || count > in.remaining()) return false;
+        tombstones.reserve(count);
+        int64_t id = 0;
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            id += in.svarint();
+            Tombstone& tombstone = tombstones[static_cast<int>(id)];
+            tombstone.hlc = in.varint();
+            tombstone.origin = static_cast<uint32_t>(in.varint());
+            tombstone.seq = in.varint();
+            tombstone.conversation = static_cast<int>(in.svarint());
+        }
+        return in.ok && tombstones.size() == count;
+    }
+
+    static void writeVector(SyncUtils::ByteWriter& out, const VersionVector& vector) {
+        out.varint(vector.size());
+        for (const auto& entry : vector) {
+            out.varint(entry.first);
+            out.varint(entry.second);
+        }
+    }
+
+    static bool readVector(SyncUtils::ByteReader& in, VersionVector& vector) {
+        uint64_t count = in.varint();
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            uint32_t origin = static_cast<uint32_t>(in.varint());
+            advance(vector, origin, in.varint());
+        }
+        return in.ok;
+    }
+
+    /**
+     * Build the tree and estimator from the stored hashes (no content is
+     * rehashed). Deferred after a restore until reconciliation needs it,
+     * so that log-based sync can start right away.
+     */
+    void ensureTree() {
+        if (!treeStale) return;
+        treeStale = false;
+        std::vector<std::pair<uint32_t, uint64_t>> leaves;
+        leaves.reserve(localMessages.size() + localTombstones.size());
+        for (const Message& msg : localMessages) {
+            leaves.push_back({SyncUtils::orderedKey(msg.id), leafHash(msg.id, msg.hash)});
+        }
+        for (const auto& entry : localTombstones) {
+            leaves.push_back({SyncUtils::orderedKey(entry.first), tombstoneLeaf(entry.first, entry.second)});
+        }
+        localStrata.clear();
+        for (const auto& leaf : leaves) localStrata.insert(leaf.first, leaf.second);
+        localTree.assign(leaves);
+    }
+
+    // Diff counters from scratch
+    void recountAll() {
+        addedCount = deletedCount = conflictCount = localOnlyCount = localDeletedCount = 0;
+        for (const Message& msg : localMessages) recount(PairState::ABSENT, classify(msg.id));
+        for (const Message& msg : remoteMessages) {
+            if (!localMessages.find(msg.id)) recount(PairState::ABSENT, classify(msg.id));
+        }
+    }
+
+    // Calculate edit distance for conflict resolution
+    int editDistance(const std::string& s1, const std::string& s2) {
+        int m = s1.length();
+        int n = s2.length();
+        std::vector<std::vector<int>> dp(m + 1, std::vector<int>(n + 1));
+
+        for (int i = 0; i <= m; i++) dp[i][0] = i;
+        for (int j = 0; j <= n; j++) dp[0][j] = j;
+
+        for (int i = 1; i <= m; i++) {
+            for (int j = 1; j <= n; j++) {
+                if (s1[i-1] == s2[j-1]) {
+                    dp[i][j] = dp[i-1][j-1];
+                } else {
+                    dp[i][j] = 1 + std::min({dp[i-1][j], dp[i][j-1], dp[i-1][j-1]});
+                }
+            }
+        }
+
+        return dp[m][n];
+    }
+
+public:
+    SyncEngine() {}
+
+    /**
+     * Add message to local store. Edits of a stored message, and writes
+     * dated at or after the clock, are stamped by the clock; the first
+     * write of an older message is history and keeps its wall time.
+     */
+    void addLocalMessage(int id, const std::string& content, long long timestamp) {
+        Message msg;
+        msg.id = id;
+        msg.content = content;
+        msg.timestamp = timestamp;
+        msg.hash = hashMessage(content);
+        stampLocal(msg);
+        storeLocal(msg);
+    }
+
+    /**
+     * Add message to remote store
+     */
+    void addRemoteMessage(int id, const std::string& content, long long timestamp) {
+        Message msg;
+        msg.id = id;
+        msg.content = content;
+        msg.timestamp = timestamp;
+        msg.hash = hashMessage(content);
+        stampFromWall(msg);
+        storeRemote(msg);
+    }
+
+    /**
+     * Node ID written into HLC stamps of local edits (tie-breaker between
+     * replicas; give each replica a distinct one)
+     */
+    void setNodeId(uint32_t id) {
+        nodeId = id;
+    }
+
+    /**
+     * Bulk load a packed message set into one side (SIDE_LOCAL or
+     * SIDE_REMOTE). Returns the number of messages loaded, or -1 if the
+     * buffer is malformed (nothing is loaded in that case). Messages are
+     * stamped with their own timestamps, so load order does not matter.
+     */
+    int loadBatch(int side, const std::string& buffer) {
+        if (side != SIDE_LOCAL && side != SIDE_REMOTE) return -1;
+        if (buffer.size() < BATCH_HEADER_SIZE) return -1;
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+        const size_t count = SyncUtils::read32(data);
+        if (count > (buffer.size() - BATCH_HEADER_SIZE) / BATCH_RECORD_SIZE) return -1;
+
+        const uint8_t* records = data + BATCH_HEADER_SIZE;
+        const char* arena = buffer.data() + BATCH_HEADER_SIZE + count * BATCH_RECORD_SIZE;
+        const size_t arenaSize = buffer.size() - BATCH_HEADER_SIZE - count * BATCH_RECORD_SIZE;
+
+        // Validate everything first so a bad buffer leaves the store untouched
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* record = records + i * BATCH_RECORD_SIZE;
+            uint32_t offset = SyncUtils::read32(record + 12);
+            uint32_t length = SyncUtils::read32(record + 16);
+            if (offset > arenaSize || length > arenaSize - offset) return -1;
+        }
+
+        MessageStore& store = side == SIDE_LOCAL ? localMessages : remoteMessages;
+        store.reserve(store.size() + count);
+
+        Message msg;
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* record = records + i * BATCH_RECORD_SIZE;
+            const char* content = arena + SyncUtils::read32(record + 12);
+            const uint32_t length = SyncUtils::read32(record + 16);
+
+            msg.id = static_cast<int>(SyncUtils::read32(record));
+            msg.timestamp = static_cast<long long>(SyncUtils::read64(record + 4));
+            msg.hash = SyncUtils::hash64(content, length);
+            msg.content.assign(content, length);
+
+            if (side == SIDE_LOCAL) {
+                // An import: its stamps are wall times, whatever the order
+                stampFromWall(msg);
+                clock.observe(msg.hlc);
+                storeLocal(msg);
+            } else {
+                stampFromWall(msg);
+                storeRemote(msg);
+            }
+        }
+
+        return static_cast<int>(count);
+    }
+
+    /**
+     * Delete a message from the local store. Leaves a tombstone stamped
+     * with the deletion time, which is logged for incremental sync and
+     * takes part in reconciliation until collectTombstones() drops it.
+     */
+    bool deleteLocalMessage(int id, long long timestamp) {
+        if (!localMessages.find(id)) return false;
+        return removeLocal(id, clock.tick(timestamp), nodeId);
+    }
+
+    /**
+     * Record that the remote side deleted id at timestamp, so the diff
+     * can report it as deleted rather than not yet loaded. False if the
+     * remote holds a newer version of the message.
+     */
+    bool addRemoteTombstone(int id, long long timestamp) {
+        Tombstone tombstone;
+        tombstone.hlc = HybridClock::fromWall(timestamp);
+        const Message* existing = remoteMessages.find(id);
+        if (existing && !deletedAfter(tombstone, *existing)) return false;
+
+        auto previous = remoteTombstones.find(id);
+        if (previous != remoteTombstones.end() && previous->second.hlc >= tombstone.hlc) return true;
+
+        PairState before = classify(id);
+        remoteMessages.erase(id);
+        remoteTombstones[id] = tombstone;
+        recount(before, classify(id));
+        return true;
+    }
+
+    /**
+     * Start tracking a peer replica (by its node ID). Tombstone collection
+     * waits for every registered peer's acknowledgement.
+     */
+    void registerPeer(uint32_t peerId) {
+        peers.emplace(peerId, PeerState());
+    }
+
+    void forgetPeer(uint32_t peerId) {
+        peers.erase(peerId);
+    }
+
+    /**
+     * The peer has applied our changes up to cursor (registers the peer
+     * if it is new). Acknowledgements never move backwards.
+     */
+    void acknowledgePeer(uint32_t peerId, uint64_t cursor) {
+        PeerState& peer = peers[peerId];
+        peer.ackedCursor = std::max(peer.ackedCursor, std::min(cursor, getCursor()));
+        // Caught up completely: the peer has everything we have
+        if (cursor >= getCursor()) {
+            for (const auto& entry : versionVector) advance(peer.seen, entry.first, entry.second);
+        }
+    }
+
+    /**
+     * Our version vector, for a peer's setPeerVersionVector():
+     *   u8 TAG_VERSION_VECTOR, varint count, (varint origin, varint hlc)*
+     */
+    std::vector<uint8_t> encodeVersionVector() const {
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_VERSION_VECTOR);
+        out.varint(versionVector.size());
+        for (const auto& entry : versionVector) {
+            out.varint(entry.first);
+            out.varint(entry.second);
+        }
+        return out.bytes;
+    }
+
+    /**
+     * Merge a peer's encodeVersionVector() into what we know it has, so
+     * changesForPeer() skips writes it already got from someone else.
+     * This assumes each replica forwards an origin's writes in stamp
+     * order, which the op log does; Merkle reconciliation remains the
+     * backstop for anything missed. False if the buffer is malformed or
+     * the peer is not registered.
+     */
+    bool setPeerVersionVector(uint32_t peerId, const std::string& buffer) {
+        SyncUtils::ByteReader in(buffer);
+        if (in.u8() != TAG_VERSION_VECTOR) return false;
+        uint64_t count = in.varint();
+        VersionVector received;
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            uint32_t origin = static_cast<uint32_t>(in.varint());
+            advance(received, origin, in.varint());
+        }
+        auto it = peers.find(peerId);
+        if (!in.ok || it == peers.end()) return false;
+        for (const auto& entry : received) advance(it->second.seen, entry.first, entry.second);
+        return true;
+    }
+
+    /**
+     * Cursor into the peer's own log up to which we have applied its
+     * changes (what to ask the peer's changesSince() for next)
+     */
+    uint64_t getPeerCursor(uint32_t peerId) const {
+        auto it = peers.find(peerId);
+        return it == peers.end() ? 0 : it->second.peerCursor;
+    }
+
+    /**
+     * Drop local tombstones whose delete every registered peer has
+     * acknowledged, and remote tombstones with no local message left to
+     * delete. Returns the number of local tombstones dropped. Cursors
+     * older than the newest dropped delete must resync afterwards; with
+     * no registered peers nothing is dropped.
+     */
+    unsigned int collectTombstones() {
+        for (auto it = remoteTombstones.begin(); it != remoteTombstones.end();) {
+            it = localMessages.find(it->first) ? std::next(it) : remoteTombstones.erase(it);
+        }
+        if (peers.empty()) return 0;
+
+        uint64_t horizon = UINT64_MAX;
+        for (const auto& peer : peers) horizon = std::min(horizon, peer.second.ackedCursor);
+
+        unsigned int dropped = 0;
+        for (auto it = localTombstones.begin(); it != localTombstones.end();) {
+            if (it->second.seq > horizon) {
+                ++it;
+                continue;
+            }
+            const int id = it->first;
+            removeLeaf(id, tombstoneLeaf(id, it->second));
+            logFloor = std::max(logFloor, it->second.seq);
+            PairState before = classify(id);
+            it = localTombstones.erase(it);
+            recount(before, classify(id));
+            dropped++;
+        }
+        return dropped;
+    }
+
+    /**
+     * Sequence number of the newest local change; a peer that has applied
+     * everything up to here passes it back to changesSince()
+     */
+    uint64_t getCursor() const {
+        return nextSeq - 1;
+    }
+
+    /**
+     * Local changes after cursor, collapsed to the newest state per ID:
+     *   u8 TAG_CHANGES, u8 flags, varint new cursor, varint count, then
+     *   one writeChange() record per ID (deletes carry their clock)
+     * If the log no longer reaches back to cursor the batch is empty with
+     * CHANGES_FULL_RESYNC set, and the peer should fall back to Merkle
+     * reconciliation or a full diff.
+     */
+    std::vector<uint8_t> changesSince(uint64_t cursor) {
+        return encodeChangesSince(cursor, nullptr);
+    }
+
+    /**
+     * changesSince() for a registered peer, from the cursor it last
+     * acknowledged and without writes its version vector already covers.
+     * Empty if the peer is not registered.
+     */
+    std::vector<uint8_t> changesForPeer(uint32_t peerId) {
+        auto it = peers.find(peerId);
+        if (it == peers.end()) return {};
+        return encodeChangesSince(it->second.ackedCursor, &it->second.seen);
+    }
+
+    /**
+     * Current state of the given IDs (messages or tombstones) as a change
+     * batch, e.g. to answer a reconciliation. Its cursor is 0 and must
+     * not replace a stored changesSince() cursor; unknown IDs are skipped.
+     */
+    std::vector<uint8_t> changesFor(const std::vector<int>& ids) {
+        SyncUtils::ByteWriter records;
+        size_t count = 0;
+        for (int id : ids) {
+            if (writeChange(records, id, OP_ADD)) count++;
+        }
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_CHANGES);
+        out.u8(0);
+        out.varint(0);
+        out.varint(count);
+        out.raw(records.bytes.data(), records.bytes.size());
+        return packPayload(std::move(out.bytes));
+    }
+
+    /**
+     * Apply a changesSince() or changesFor() batch to the local store.
+     * Writes and deletes older than what we already have are skipped.
+     * Returns the number of changes applied, or -1 if the batch is
+     * malformed; cursor and fullResync receive the batch header.
+     */
+    int applyChanges(const std::string& buffer, uint64_t& cursor, bool& fullResync) {
+        return applyChangeBatch(buffer, cursor, fullResync, nullptr);
+    }
+
+    /**
+     * applyChanges() for a batch from the peer's changesForPeer() or
+     * changesSince(). Advances getPeerCursor(peerId) and records the
+     * batch's writes as seen by the peer. -1 if the peer is not registered.
+     */
+    int applyPeerChanges(uint32_t peerId, const std::string& buffer, bool& fullResync) {
+        auto it = peers.find(peerId);
+        if (it == peers.end()) return -1;
+        PeerState& peer = it->second;
+        uint64_t cursor = 0;
+        int applied = applyChangeBatch(buffer, cursor, fullResync, &peer.seen);
+        if (applied >= 0 && !fullResync) peer.peerCursor = std::max(peer.peerCursor, cursor);
+        return applied;
+    }
 
-    // Simple hash function for change detection
-    std::string hashMessage(const std::string& content) {
-        unsigned long hash = 5381;
-        for (char c : content) {
-            hash = ((hash << 5) + hash) + c;
+    /**
+     * Assign a message (or its tombstone) to a conversation for priority
+     * sync. False if the ID is unknown.
+     */
+    bool setConversation(int id, int conversationId) {
+        if (Message* msg = localMessages.find(id)) {
+            msg->conversation = conversationId;
+            return true;
         }
-        return std::to_string(hash);
+        auto it = localTombstones.find(id);
+        if (it == localTombstones.end()) return false;
+        it->second.conversation = conversationId;
+        return true;
     }
 
-    // Calculate edit distance for conflict resolution
-    int editDistance(const std::string& s1, const std::string& s2) {
-        int m = s1.length();
-        int n = s2.length();
-        std::vector<std::vector<int>> dp(m + 1, std::vector<int>(n + 1));
+    /**
+     * Sync priority of a conversation, e.g. highest for the one on screen
+     * and lower for recent ones; 0 (the default) drains last. Priority
+     * syncs in progress pick up the change from their next batch.
+     */
+    void setConversationPriority(int conversationId, int priority) {
+        if (priority) conversationPriorities[conversationId] = priority;
+        else conversationPriorities.erase(conversationId);
+        priorityVersion++;
+    }
 
-        for (int i = 0; i <= m; i++) dp[i][0] = i;
-        for (int j = 0; j <= n; j++) dp[0][j] = j;
+    /**
+     * Plan sending the peer everything past its acknowledged cursor in
+     * priority order (see setConversationPriority) instead of log order.
+     * Returns the number of changes planned (0 for an unregistered peer);
+     * drain them with nextSyncBatch().
+     */
+    unsigned int beginPrioritySync(uint32_t peerId) {
+        auto it = peers.find(peerId);
+        if (it == peers.end()) return 0;
+        PeerState& peer = it->second;
+        SyncPlan& plan = peer.plan;
+        plan = SyncPlan();
+        plan.active = true;
+        plan.cursor = getCursor();
+        if (peer.ackedCursor < logFloor || peer.ackedCursor > getCursor()) {
+            plan.resync = true;
+            return 0;
+        }
 
-        for (int i = 1; i <= m; i++) {
-            for (int j = 1; j <= n; j++) {
-                if (s1[i-1] == s2[j-1]) {
-                    dp[i][j] = dp[i-1][j-1];
-                } else {
-                    dp[i][j] = 1 + std::min({dp[i-1][j], dp[i][j-1], dp[i-1][j-1]});
-                }
+        std::vector<const LogEntry*> changes;
+        collectChanges(peer.ackedCursor, changes);
+        plan.changes.reserve(changes.size());
+        for (const LogEntry* entry : changes) {
+            PlannedChange change = {entry->id, 0, 0, 0, 0};
+            if (const Message* msg = localMessages.find(entry->id)) {
+                if (covers(peer.seen, msg->origin, msg->hlc)) continue;
+                change.conversation = msg->conversation;
+                change.recency = msg->timestamp;
+            } else {
+                auto it = localTombstones.find(entry->id);
+                if (it == localTombstones.end() || covers(peer.seen, it->second.origin, it->second.hlc)) continue;
+                change.conversation = it->second.conversation;
+                change.recency = HybridClock::physical(it->second.hlc);
             }
+            plan.changes.push_back(change);
         }
+        orderPlan(plan);
+        return static_cast<unsigned int>(plan.changes.size());
+    }
 
-        return dp[m][n];
+    /**
+     * Next batch of a priority sync in the changesSince() format, holding
+     * about maxBytes of records (before compression) or what fits in
+     * maxMillis of encoding; 0 lifts either limit. A conversation with a
+     * priority above 0 is never split: the batch ends before it, or takes
+     * it whole if it comes first, so the visible conversation arrives
+     * consistent in one batch. Earlier batches carry cursor 0 and the
+     * last one the plan's cursor; after it, or for an unregistered peer,
+     * an empty buffer is returned.
+     */
+    std::vector<uint8_t> nextSyncBatch(uint32_t peerId, unsigned int maxBytes, double maxMillis) {
+        auto it = peers.find(peerId);
+        if (it == peers.end() || !it->second.plan.active) return {};
+        PeerState& peer = it->second;
+        SyncPlan& plan = peer.plan;
+
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_CHANGES);
+        if (plan.resync) {
+            plan.active = false;
+            out.u8(CHANGES_FULL_RESYNC);
+            out.varint(getCursor());
+            out.varint(0);
+            return out.bytes;
+        }
+        if (plan.priorityVersion != priorityVersion) orderPlan(plan);
+
+        const auto start = std::chrono::steady_clock::now();
+        auto outOfTime = [&]() {
+            return maxMillis > 0 && std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count() >= maxMillis;
+        };
+
+        SyncUtils::ByteWriter records;
+        size_t count = 0;
+        while (plan.next < plan.changes.size()) {
+            // A prioritized conversation goes as one group, the rest singly
+            const PlannedChange& head = plan.changes[plan.next];
+            size_t end = plan.next + 1;
+            if (head.priority > 0) {
+                while (end < plan.changes.size() && plan.changes[end].conversation == head.conversation) end++;
+            }
+
+            size_t mark = records.bytes.size();
+            size_t written = 0;
+            for (size_t i = plan.next; i < end; i++) {
+                if (writeChange(records, plan.changes[i].id, OP_ADD, &peer.seen)) written++;
+            }
+            if (count > 0 && maxBytes && records.bytes.size() > maxBytes) {
+                records.bytes.resize(mark);
+                break;
+            }
+            count += written;
+            plan.next = end;
+            if ((maxBytes && records.bytes.size() >= maxBytes) || outOfTime()) break;
+        }
+
+        bool last = plan.next == plan.changes.size();
+        if (last) plan.active = false;
+        out.u8(0);
+        out.varint(last ? plan.cursor : 0);
+        out.varint(count);
+        out.raw(records.bytes.data(), records.bytes.size());
+        return packPayload(std::move(out.bytes));
     }
 
-public:
-    SyncEngine() {}
+    /**
+     * How long small updates are held to coalesce (default 200 ms)
+     */
+    void setCoalesceWindow(unsigned int windowMs) {
+        coalescer.setWindow(windowMs);
+    }
 
     /**
-     * Add message to local store
+     * Queue an ephemeral update (typing indicator, reaction, read
+     * receipt) keyed by (entity, field); a newer one for the same key
+     * replaces it. Returns true once a batch is due for flushUpdates().
      */
-    void addLocalMessage(int id, const std::string& content, long long timestamp) {
-        Message msg;
-        msg.id = id;
-        msg.content = content;
-        msg.timestamp = timestamp;
-        msg.hash = hashMessage(content);
-        localMessages[id] = msg;
+    bool queueUpdate(int entity, unsigned int field, const std::string& value, long long nowMs) {
+        coalescer.queue(entity, field, value, nowMs);
+        return coalescer.due(nowMs);
+    }
+
+    bool updatesDue(long long nowMs) const {
+        return coalescer.due(nowMs);
     }
 
     /**
-     * Add message to remote store
+     * Everything queued as one batch (u8 TAG_UPDATES, then the coalescer
+     * encoding); empty if nothing is pending
      */
-    void addRemoteMessage(int id, const std::string& content, long long timestamp) {
-        Message msg;
-        msg.id = id;
-        msg.content = content;
-        msg.timestamp = timestamp;
-        msg.hash = hashMessage(content);
-        remoteMessages[id] = msg;
+    std::vector<uint8_t> flushUpdates() {
+        SyncUtils::ByteWriter out;
+        if (coalescer.size() == 0) return out.bytes;
+        out.u8(TAG_UPDATES);
+        coalescer.flush(out);
+        return packPayload(std::move(out.bytes));
+    }
+
+    /**
+     * Decode a peer's flushUpdates() batch; false if it is malformed
+     */
+    bool decodeUpdates(const std::string& buffer, std::vector<UpdateCoalescer::Update>& updates) const {
+        std::string storage;
+        const std::string* payload;
+        if (!unpackPayload(buffer, storage, payload)) return false;
+        SyncUtils::ByteReader in(*payload);
+        if (in.u8() != TAG_UPDATES) return false;
+        return UpdateCoalescer::decode(in, updates);
+    }
+
+    /**
+     * loadBatch for a buffer produced by compressPayload()
+     */
+    int loadCompressedBatch(int side, const std::string& buffer) {
+        std::string storage;
+        const std::string* payload;
+        if (buffer.empty() || static_cast<uint8_t>(buffer[0]) != TAG_COMPRESSED) return -1;
+        if (!unpackPayload(buffer, storage, payload)) return -1;
+        return loadBatch(side, *payload);
+    }
+
+    /**
+     * Train a compression dictionary of up to maxBytes from a sample of
+     * the local store and start using it. Returns the dictionary, which
+     * peers must install with setDictionary() to read our payloads.
+     */
+    std::string trainDictionary(unsigned int maxBytes) {
+        std::vector<const std::string*> samples;
+        size_t totalBytes = 0;
+        for (const Message& msg : localMessages) totalBytes += msg.content.size();
+        // Evenly strided sample so that old and new messages are both represented
+        size_t stride = std::max<size_t>(1, totalBytes / DICTIONARY_SAMPLE_BYTES);
+        size_t index = 0;
+        for (const Message& msg : localMessages) {
+            if (index++ % stride == 0) samples.push_back(&msg.content);
+        }
+        std::string dictionary = BlockCompressor::train(samples, maxBytes);
+        compressor.setDictionary(dictionary);
+        return dictionary;
+    }
+
+    void setDictionary(const std::string& dictionary) {
+        compressor.setDictionary(dictionary);
+    }
+
+    /**
+     * Compress outgoing batches (delta batches, change batches, text
+     * updates); incoming compressed payloads are always accepted
+     */
+    void setCompression(bool enabled) {
+        compressionEnabled = enabled;
+    }
+
+    /**
+     * Compress an arbitrary payload (e.g. a loadBatch buffer) with the
+     * current dictionary
+     */
+    std::vector<uint8_t> compressPayload(const std::string& buffer) {
+        return compressWrapped(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
     }
 
     /**
      * Calculate differences between local and remote
-     * Returns: [added_ids, modified_ids, deleted_ids]
+     * Returns the IDs of each kind: added, modified, deleted (remote
+     * tombstone), localOnly, localDeleted (remote copy of a message we
+     * deleted); JS receives them as an object with those keys
      */
-    val calculateDiff() {
-        std::vector<int> added;
-        std::vector<int> modified;
-        std::vector<int> deleted;
+    DiffLists calculateDiff() {
+        DiffLists lists;
 
-        // Find added and modified messages
-        for (const auto& pair : remoteMessages) {
-            int id = pair.first;
-            const Message& remoteMsg = pair.second;
+        // Linear merge over the ID-sorted columns of both stores
+        size_t i = 0, j = 0;
+        mergeDiff(i, j, SIZE_MAX, [&](int kind, int id) { lists[kind - 1].push_back(id); });
+        return lists;
+    }
 
-            auto localIt = localMessages.find(id);
-            if (localIt == localMessages.end()) {
-                // New message on remote
-                added.push_back(id);
-            } else if (localIt->second.hash != remoteMsg.hash) {
-                // Modified message
-                modified.push_back(id);
-            }
+    /**
+     * Start a streaming diff that yields up to chunkRecords (kind, id)
+     * records per nextDiffChunk() call (0 picks a default)
+     */
+    void beginDiff(unsigned int chunkRecords) {
+        diffCursor = DiffCursor();
+        diffCursor.chunkRecords = chunkRecords ? chunkRecords : DEFAULT_DIFF_CHUNK;
+        diffCursor.chunk.reserve(diffCursor.chunkRecords * 2);
+        diffCursor.generation = storeGeneration();
+    }
+
+    /**
+     * Fill the chunk buffer with the next records in ascending ID order.
+     * Returns the number of records (0 once the diff is exhausted). If the
+     * stores change between calls the diff resumes after the last ID
+     * returned, against the current contents.
+     */
+    unsigned int nextDiffChunk() {
+        DiffCursor& cursor = diffCursor;
+        cursor.chunk.clear();
+        if (cursor.chunkRecords == 0) return 0;
+
+        if (cursor.generation != storeGeneration()) {
+            cursor.generation = storeGeneration();
+            auto resume = [&](const MessageStore& store) -> size_t {
+                const auto& sorted = store.byId();
+                if (!cursor.started) return 0;
+                return std::upper_bound(sorted.begin(), sorted.end(), cursor.lastId,
+                    [](int id, const MessageStore::SortedEntry& entry) { return id < entry.id; }) - sorted.begin();
+            };
+            cursor.localPos = resume(localMessages);
+            cursor.remotePos = resume(remoteMessages);
         }
 
-        // Find deleted messages
-        for (const auto& pair : localMessages) {
-            int id = pair.first;
-            if (remoteMessages.find(id) == remoteMessages.end()) {
-                deleted.push_back(id);
-            }
+        size_t count = mergeDiff(cursor.localPos, cursor.remotePos, cursor.chunkRecords, [&](int kind, int id) {
+            cursor.chunk.push_back(kind);
+            cursor.chunk.push_back(id);
+        });
+        if (count > 0) {
+            cursor.started = true;
+            cursor.lastId = cursor.chunk.back();
         }
+        return static_cast<unsigned int>(count);
+    }
 
-        val result = val::object();
-        result.set("added", val::array(added.begin(), added.end()));
-        result.set("modified", val::array(modified.begin(), modified.end()));
-        result.set("deleted", val::array(deleted.begin(), deleted.end()));
+    // Records of the last chunk as interleaved (kind, id) pairs
+    const std::vector<int32_t>& diffChunk() const {
+        return diffCursor.chunk;
+    }
 
-        return result;
+    /**
+     * Start reconciling the local store against a peer replica.
+     * Returns the first range query to send to the peer.
+     *
+     * Protocol: send each query to the peer's answerRangeQuery, feed the
+     * reply to continueReconcile, and repeat until it returns an empty
+     * buffer. Only ranges whose hashes differ are expanded, so the bytes
+     * exchanged grow with diff size * tree depth rather than store size.
+     * Tombstones are part of the set, so deletes show up as differences
+     * and travel with changesFor() like any other record.
+     */
+    std::vector<uint8_t> beginReconcile() {
+        ensureTree();
+        pendingQueries.assign(1, {0, 0});
+        reconcileAdded.clear();
+        reconcileModified.clear();
+        reconcileDeleted.clear();
+        return encodeQueries();
     }
 
     /**
-     * Generate delta for a modified message
+     * Peer side: answer each queried range with its full (id, leaf hash)
+     * list if small, otherwise with the (count, hash) of its 16 children
      */
-    std::string generateDelta(int id) {
-        auto localIt = localMessages.find(id);
-        auto remoteIt = remoteMessages.find(id);
+    std::vector<uint8_t> answerRangeQuery(const std::string& request) {
+        ensureTree();
+        SyncUtils::ByteReader in(request);
+        SyncUtils::ByteWriter out;
+        if (in.u8() != TAG_RANGE_QUERY) return out.bytes;
 
-        if (localIt == localMessages.end() || remoteIt == remoteMessages.end()) {
-            return "";
+        uint64_t count = in.varint();
+        std::vector<RangeQuery> queries;
+        for (uint64_t i = 0; i < count && in.ok; i++) {
+            int level = in.u8();
+            uint32_t prefix = static_cast<uint32_t>(in.varint());
+            if (level >= MerkleTree::LEAF_LEVEL) in.ok = false;
+            queries.push_back({level, prefix});
         }
+        if (!in.ok) return out.bytes;
 
-        const std::string& oldContent = localIt->second.content;
-        const std::string& newContent = remoteIt->second.content;
+        out.u8(TAG_RANGE_REPLY);
+        out.varint(queries.size());
+        for (const auto& query : queries) {
+            MerkleTree::Node node = localNode(query.level, query.prefix);
+            out.varint(node.count);
+            if (node.count <= LEAF_LIST_MAX) {
+                auto emit = [&](int id, uint64_t hash) {
+                    out.svarint(id);
+                    out.u64(hash);
+                };
+                forEachLocalLeaf(query.level, query.prefix, emit);
+                continue;
+            }
+            for (uint32_t child = 0; child < MerkleTree::FANOUT; child++) {
+                MerkleTree::Node childNode = localNode(query.level + 1,
+                    (query.prefix << MerkleTree::FANOUT_BITS) | child);
+                out.varint(childNode.count);
+                if (childNode.count > 0) out.u64(childNode.hash);
+            }
+        }
+        return out.bytes;
+    }
 
-        // Simple delta format: "pos:del:ins"
-        std::string delta;
-        size_t i = 0;
+    /**
+     * Initiator side: consume a reply and return the next query
+     * (empty when reconciliation is complete)
+     */
+    std::vector<uint8_t> continueReconcile(const std::string& reply) {
+        ensureTree();
+        SyncUtils::ByteReader in(reply);
+        std::vector<RangeQuery> next;
 
-        // Find common prefix
-        while (i < oldContent.length() && i < newContent.length() &&
-               oldContent[i] == newContent[i]) {
-            i++;
+        if (in.u8() != TAG_RANGE_REPLY || in.varint() != pendingQueries.size()) {
+            pendingQueries.clear();
+            return {};
         }
 
-        delta += std::to_string(i) + ":";
+        std::vector<std::pair<int, uint64_t>> remoteLeaves;
+        for (const auto& query : pendingQueries) {
+            uint32_t remoteCount = static_cast<uint32_t>(in.varint());
+
+            if (remoteCount <= LEAF_LIST_MAX) {
+                remoteLeaves.clear();
+                uint64_t remoteHash = 0;
+                for (uint32_t i = 0; i < remoteCount && in.ok; i++) {
+                    int id = static_cast<int>(in.svarint());
+                    remoteLeaves.push_back({id, in.u64()});
+                    remoteHash += remoteLeaves.back().second;
+                }
+                MerkleTree::Node local = localNode(query.level, query.prefix);
+                if (in.ok && (local.count != remoteCount || local.hash != remoteHash)) {
+                    diffLeafRange(query.level, query.prefix, remoteLeaves);
+                }
+                continue;
+            }
+
+            for (uint32_t child = 0; child < MerkleTree::FANOUT && in.ok; child++) {
+                const int level = query.level + 1;
+                const uint32_t prefix = (query.prefix << MerkleTree::FANOUT_BITS) | child;
+                uint32_t childCount = static_cast<uint32_t>(in.varint());
+                uint64_t childHash = childCount > 0 ? in.u64() : 0;
 
-        // Find common suffix
-        size_t oldEnd = oldContent.length();
-        size_t newEnd = newContent.length();
-        while (oldEnd > i && newEnd > i &&
-               oldContent[oldEnd - 1] == newContent[newEnd - 1]) {
-            oldEnd--;
-            newEnd--;
+                MerkleTree::Node local = localNode(level, prefix);
+                if (local.count == childCount && local.hash == childHash) continue;
+
+                if (childCount == 0) {
+                    // Peer has nothing here; no need to ask
+                    auto markDeleted = [&](int id, uint64_t) { reconcileDeleted.push_back(id); };
+                    forEachLocalLeaf(level, prefix, markDeleted);
+                } else {
+                    next.push_back({level, prefix});
+                }
+            }
         }
 
-        // Deleted characters
-        delta += std::to_string(oldEnd - i) + ":";
+        if (!in.ok) next.clear();
+        pendingQueries = std::move(next);
+        return encodeQueries();
+    }
+
+    /**
+     * Step 1 (initiator): fixed-size estimator of the local set
+     */
+    std::vector<uint8_t> encodeStrataEstimator() {
+        ensureTree();
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_STRATA);
+        localStrata.encode(out);
+        return out.bytes;
+    }
+
+    /**
+     * Step 2 (peer): estimate the difference from the initiator's
+     * estimator and reply with an IBLT of the local set sized to it.
+     * An estimate larger than the local set (a corrupt estimator, or a
+     * peer holding far more) gets an empty reply, which sends the
+     * initiator to Merkle reconciliation instead.
+     */
+    std::vector<uint8_t> encodeIBLTForPeer(const std::string& peerEstimator) {
+        ensureTree();
+        SyncUtils::ByteReader in(peerEstimator);
+        SyncUtils::ByteWriter out;
+        StrataEstimator remote;
+        if (in.u8() != TAG_STRATA || !remote.decodeFrom(in)) return out.bytes;
 
-        // Inserted characters
-        delta += newContent.substr(i, newEnd - i);
+        uint64_t estimate = localStrata.estimateDifference(remote);
+        if (estimate > localMessages.size() + localTombstones.size() + IBLT_MIN_CELLS) return out.bytes;
+        size_t cells = std::max(IBLT_MIN_CELLS, static_cast<size_t>(estimate) * IBLT_CELLS_PER_DIFF);
 
-        return delta;
+        InvertibleBloomTable table(cells);
+        insertLocalLeaves(table);
+
+        out.u8(TAG_IBLT);
+        out.varint(table.size());
+        table.encode(out);
+        return out.bytes;
     }
 
     /**
-     * Apply delta to message
+     * Step 3 (initiator): subtract the local set from the peer's IBLT and
+     * decode the symmetric difference into the reconcile result.
+     * Returns an empty buffer on success. If decoding fails, Merkle range
+     * reconciliation is started instead and its first query is returned.
      */
-    std::string applyDelta(const std::string& content, const std::string& delta) {
-        // Parse delta: "pos:del:ins"
-        size_t firstColon = delta.find(':');
-        size_t secondColon = delta.find(':', firstColon + 1);
+    std::vector<uint8_t> decodePeerIBLT(const std::string& peerTable) {
+        SyncUtils::ByteReader in(peerTable);
+        if (in.u8() != TAG_IBLT) return beginReconcile();
+
+        uint64_t cells = in.varint();
+        if (!in.ok || cells == 0 || cells > peerTable.size()) return beginReconcile();
+
+        InvertibleBloomTable difference(cells);
+        if (!difference.decodeFrom(in) || difference.size() != cells) return beginReconcile();
+
+        InvertibleBloomTable local(cells);
+        insertLocalLeaves(local);
+        difference.subtract(local);
+
+        std::vector<InvertibleBloomTable::Element> peerOnly, localOnly;
+        if (!difference.decode(peerOnly, localOnly)) return beginReconcile();
 
-        if (firstColon == std::string::npos || secondColon == std::string::npos) {
-            return content; // Invalid delta
+        // The same ID on both sides with different hashes is a modification
+        std::vector<int> peerIds, localIds;
+        for (const auto& element : peerOnly) peerIds.push_back(SyncUtils::keyToId(element.key));
+        for (const auto& element : localOnly) localIds.push_back(SyncUtils::keyToId(element.key));
+        std::sort(peerIds.begin(), peerIds.end());
+        std::sort(localIds.begin(), localIds.end());
+
+        pendingQueries.clear();
+        reconcileAdded.clear();
+        reconcileModified.clear();
+        reconcileDeleted.clear();
+        std::set_intersection(peerIds.begin(), peerIds.end(), localIds.begin(), localIds.end(),
+                              std::back_inserter(reconcileModified));
+        std::set_difference(peerIds.begin(), peerIds.end(), localIds.begin(), localIds.end(),
+                            std::back_inserter(reconcileAdded));
+        std::set_difference(localIds.begin(), localIds.end(), peerIds.begin(), peerIds.end(),
+                            std::back_inserter(reconcileDeleted));
+        return {};
+    }
+
+    /**
+     * Differences found by the last reconciliation, relative to the peer:
+     * added = ids only the peer has, modified, deleted = ids only we have.
+     * Either side's record may be a tombstone.
+     */
+    const std::vector<int>& reconciledAdded() const {
+        return reconcileAdded;
+    }
+
+    const std::vector<int>& reconciledModified() const {
+        return reconcileModified;
+    }
+
+    const std::vector<int>& reconciledDeleted() const {
+        return reconcileDeleted;
+    }
+
+    bool reconcileComplete() const {
+        return pendingQueries.empty();
+    }
+
+#ifdef __EMSCRIPTEN__
+    /**
+     * Hash and count of one tree range (level 0 = whole store)
+     */
+    val getRangeHash(int level, unsigned int prefix) {
+        ensureTree();
+        val result = val::object();
+        if (level < 0 || level > MerkleTree::LEAF_LEVEL) return result;
+        MerkleTree::Node node = localNode(level, prefix);
+        result.set("count", static_cast<int>(node.count));
+        result.set("hash", std::to_string(node.hash));
+        return result;
+    }
+#endif
+
+    /**
+     * Generate a binary delta turning the local version of a message into
+     * the remote one (empty if either side is missing)
+     */
+    std::vector<uint8_t> generateDelta(int id) {
+        const Message* local = localMessages.find(id);
+        const Message* remote = remoteMessages.find(id);
+
+        if (!local || !remote) {
+            return {};
+        }
+
+        SyncUtils::ByteWriter out;
+        deltaCodec.encode(local->content, remote->content, out);
+        return out.bytes;
+    }
+
+    /**
+     * Deltas for every modified message in one framed buffer:
+     *   u8 TAG_DELTA_BATCH, varint count, then per message
+     *   svarint id, svarint timestamp, varint hlc, varint origin,
+     *   u64 base hash, u64 target hash, varint delta length, delta bytes
+     * Messages are ordered by ID.
+     */
+    std::vector<uint8_t> generateAllDeltas() {
+        std::vector<int> modified;
+        diffStores(nullptr, &modified, nullptr);
+
+        SyncUtils::ByteWriter out;
+        SyncUtils::ByteWriter delta;
+        out.u8(TAG_DELTA_BATCH);
+        out.varint(modified.size());
+        for (int id : modified) {
+            const Message& base = *localMessages.find(id);
+            const Message& target = *remoteMessages.find(id);
+
+            delta.bytes.clear();
+            deltaCodec.encode(base.content, target.content, delta);
+
+            out.svarint(id);
+            out.svarint(target.timestamp);
+            out.varint(target.hlc);
+            out.varint(target.origin);
+            out.u64(base.hash);
+            out.u64(target.hash);
+            out.varint(delta.bytes.size());
+            out.raw(delta.bytes.data(), delta.bytes.size());
         }
+        return packPayload(std::move(out.bytes));
+    }
+
+    /**
+     * Apply a generateAllDeltas() buffer to the local store in one pass.
+     * A delta is only applied if the local base hash matches and the
+     * result hashes to the target; other IDs are reported in failed so
+     * the caller can fetch them in full. Returns the number applied, or
+     * -1 if the framing is malformed (messages before the damage stay
+     * applied).
+     */
+    int applyDeltaBatch(const std::string& buffer, std::vector<int>& failed) {
+        std::string storage;
+        const std::string* payload;
+        if (!unpackPayload(buffer, storage, payload)) return -1;
+        SyncUtils::ByteReader in(*payload);
+        if (in.u8() != TAG_DELTA_BATCH) return -1;
+        uint64_t count = in.varint();
+        if (!in.ok) return -1;
 
-        int pos = std::stoi(delta.substr(0, firstColon));
-        int delCount = std::stoi(delta.substr(firstColon + 1, secondColon - firstColon - 1));
-        std::string insertion = delta.substr(secondColon + 1);
+        int applied = 0;
+        Message updated;
+        for (uint64_t i = 0; i < count; i++) {
+            int id = static_cast<int>(in.svarint());
+            long long timestamp = in.svarint();
+            uint64_t hlc = in.varint();
+            uint32_t origin = static_cast<uint32_t>(in.varint());
+            uint64_t baseHash = in.u64();
+            uint64_t targetHash = in.u64();
+            uint64_t length = in.varint();
+            const uint8_t* delta = in.ok ? in.raw(length) : nullptr;
+            if (!delta) return -1;
 
-        std::string result = content.substr(0, pos) + insertion;
-        if (pos + delCount < content.length()) {
-            result += content.substr(pos + delCount);
+            const Message* local = localMessages.find(id);
+            if (!local || local->hash != baseHash ||
+                !DeltaCodec::apply(local->content, delta, length, updated.content) ||
+                hashMessage(updated.content) != targetHash) {
+                failed.push_back(id);
+                continue;
+            }
+
+            updated.id = id;
+            updated.timestamp = timestamp;
+            updated.hash = targetHash;
+            updated.hlc = hlc;
+            updated.origin = origin;
+            clock.observe(hlc);
+            storeLocal(updated);
+            applied++;
         }
+        return applied;
+    }
 
+    /**
+     * Apply delta to message; malformed deltas leave the content unchanged
+     */
+    std::string applyDelta(const std::string& content, const std::string& delta) {
+        std::string result;
+        if (!DeltaCodec::apply(content, reinterpret_cast<const uint8_t*>(delta.data()), delta.size(), result)) {
+            return content;
+        }
         return result;
     }
 
+#ifdef __EMSCRIPTEN__
     /**
-     * Resolve conflict (simple last-write-wins)
+     * Resolve conflict (last-writer-wins on HLC stamps)
      */
     val resolveConflict(int id) {
-        auto localIt = localMessages.find(id);
-        auto remoteIt = remoteMessages.find(id);
+        const Message* local = localMessages.find(id);
+        const Message* remote = remoteMessages.find(id);
 
         val result = val::object();
 
-        if (localIt == localMessages.end() || remoteIt == localMessages.end()) {
+        if (!local || !remote) {
             result.set("resolved", false);
             return result;
         }
 
-        // Use timestamp for resolution
-        bool useRemote = remoteIt->second.timestamp > localIt->second.timestamp;
-        
+        bool useRemote = newerThan(*remote, *local);
+
         result.set("resolved", true);
         result.set("useRemote", useRemote);
-        result.set("winner", useRemote ? 
-                   remoteIt->second.content : localIt->second.content);
+        result.set("winner", useRemote ? remote->content : local->content);
 
         return result;
     }
+#endif
+
+    /**
+     * Resolve every conflicting ID (present on both sides with different
+     * content) in one pass. ids is filled in ascending order and bit i of
+     * winners (LSB first) is set when the remote version of ids[i] wins.
+     * With apply, remote winners are written to the local store.
+     */
+    void resolveAll(bool apply, std::vector<int>& ids, std::vector<uint8_t>& winners) {
+        ids.clear();
+        diffStores(nullptr, &ids, nullptr);
+
+        winners.assign((ids.size() + 7) / 8, 0);
+        for (size_t i = 0; i < ids.size(); i++) {
+            const Message& remote = *remoteMessages.find(ids[i]);
+            if (!newerThan(remote, *localMessages.find(ids[i]))) continue;
+            winners[i >> 3] |= static_cast<uint8_t>(1u << (i & 7));
+            if (apply) {
+                clock.observe(remote.hlc);
+                storeLocal(remote);
+            }
+        }
+    }
+
+    /**
+     * Insert text into a shared document at a code point position,
+     * attributed to this replica's node ID
+     */
+    void textInsert(int docId, unsigned int pos, const std::string& text) {
+        document(docId).insert(nodeId, pos, text);
+    }
+
+    /**
+     * Delete length code points from a shared document
+     */
+    void textDelete(int docId, unsigned int pos, unsigned int length) {
+        document(docId).remove(pos, length);
+    }
+
+    std::string getText(int docId) {
+        return document(docId).text();
+    }
+
+    unsigned int getTextLength(int docId) {
+        return static_cast<unsigned int>(document(docId).length());
+    }
+
+    /**
+     * Parts of an update still waiting for causally earlier parts
+     */
+    unsigned int getTextPendingCount(int docId) {
+        return static_cast<unsigned int>(document(docId).pendingCount());
+    }
+
+    /**
+     * What this replica has of a document, for a peer's encodeTextUpdate
+     */
+    std::vector<uint8_t> encodeTextStateVector(int docId) {
+        SyncUtils::ByteWriter out;
+        out.u8(TAG_STATE_VECTOR);
+        document(docId).encodeStateVector(out);
+        return out.bytes;
+    }
+
+    /**
+     * Everything the peer with the given state vector is missing; an
+     * empty state vector means the whole document
+     */
+    std::vector<uint8_t> encodeTextUpdate(int docId, const std::string& stateVector) {
+        std::unordered_map<uint32_t, uint32_t> known;
+        SyncUtils::ByteWriter out;
+        if (!stateVector.empty()) {
+            SyncUtils::ByteReader in(stateVector);
+            if (in.u8() != TAG_STATE_VECTOR || !TextDocument::decodeStateVector(in, known)) return out.bytes;
+        }
+        out.u8(TAG_TEXT_UPDATE);
+        document(docId).encodeUpdate(known, out);
+        return packPayload(std::move(out.bytes));
+    }
+
+    /**
+     * Merge a peer's update; false if it is malformed
+     */
+    bool applyTextUpdate(int docId, const std::string& update) {
+        std::string storage;
+        const std::string* payload;
+        if (!unpackPayload(update, storage, payload)) return false;
+        SyncUtils::ByteReader in(*payload);
+        if (in.u8() != TAG_TEXT_UPDATE) return false;
+        return document(docId).applyUpdate(in);
+    }
+
+    /**
+     * Everything needed to pick up where this engine left off, as one
+     * versioned blob:
+     *   u8 TAG_SNAPSHOT, u8 SNAPSHOT_VERSION, varint node ID, varint
+     *   clock, varint next sequence, varint log floor, u8 flags,
+     *   dictionary, local and remote messages (with content hashes and
+     *   clocks), local and remote tombstones, op log, version vector,
+     *   peers, conversation priorities, text documents, u64 checksum
+     * The diff counters are rebuilt on load, and the Merkle tree and strata
+     * estimator on first use, from the stored hashes. In-flight diffs,
+     * reconciliations, priority syncs and queued updates are not saved.
+     */
+    std::vector<uint8_t> serialize() const {
+        SyncUtils::ByteWriter out;
+        size_t estimate = 64 + compressor.dictionary().size() + opLog.size() * 8;
+        for (const MessageStore* store : {&localMessages, &remoteMessages}) {
+            for (const Message& msg : *store) estimate += msg.content.size() + 40;
+        }
+        out.bytes.reserve(estimate);
+        out.u8(TAG_SNAPSHOT);
+        out.u8(SNAPSHOT_VERSION);
+        out.varint(nodeId);
+        out.varint(clock.now());
+        out.varint(nextSeq);
+        out.varint(logFloor);
+        out.u8(compressionEnabled ? SNAPSHOT_COMPRESSION : 0);
+        const std::string& dictionary = compressor.dictionary();
+        out.varint(dictionary.size());
+        out.raw(dictionary.data(), dictionary.size());
+
+        writeStore(out, localMessages);
+        writeStore(out, remoteMessages);
+        writeTombstones(out, localTombstones);
+        writeTombstones(out, remoteTombstones);
+
+        out.varint(opLog.size());
+        uint64_t previousSeq = 0;
+        for (const LogEntry& entry : opLog) {
+            out.varint(entry.seq - previousSeq);
+            previousSeq = entry.seq;
+            out.svarint(entry.id);
+            out.u8(entry.op);
+        }
+
+        writeVector(out, versionVector);
+        out.varint(peers.size());
+        for (const auto& peer : peers) {
+            out.varint(peer.first);
+            out.varint(peer.second.ackedCursor);
+            out.varint(peer.second.peerCursor);
+            writeVector(out, peer.second.seen);
+        }
+
+        out.varint(conversationPriorities.size());
+        for (const auto& entry : conversationPriorities) {
+            out.svarint(entry.first);
+            out.svarint(entry.second);
+        }
+
+        const std::unordered_map<uint32_t, uint32_t> everything;
+        SyncUtils::ByteWriter update;
+        out.varint(documents.size());
+        for (const auto& entry : documents) {
+            update.bytes.clear();
+            entry.second->encodeUpdate(everything, update);
+            out.svarint(entry.first);
+            out.varint(update.bytes.size());
+            out.raw(update.bytes.data(), update.bytes.size());
+        }
+
+        out.u64(SyncUtils::hash64(out.bytes.data(), out.bytes.size()));
+        return out.bytes;
+    }
+
+    /**
+     * Replace the whole state with a serialize() blob. Returns false, and
+     * changes nothing, if the blob is damaged or from another version.
+     * The clock never moves backwards.
+     */
+    bool deserialize(const std::string& buffer) {
+        if (buffer.size() < 2 + 8) return false;
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+        const size_t bodySize = buffer.size() - 8;
+        if (SyncUtils::read64(data + bodySize) != SyncUtils::hash64(data, bodySize)) return false;
+
+        SyncUtils::ByteReader in(data, bodySize);
+        if (in.u8() != TAG_SNAPSHOT || in.u8() != SNAPSHOT_VERSION) return false;
+
+        SyncEngine restored;
+        restored.nodeId = static_cast<uint32_t>(in.varint());
+        restored.clock.observe(in.varint());
+        restored.clock.observe(clock.now());
+        restored.nextSeq = in.varint();
+        restored.logFloor = in.varint();
+        restored.compressionEnabled = (in.u8() & SNAPSHOT_COMPRESSION) != 0;
+        uint64_t dictionarySize = in.varint();
+        const uint8_t* dictionary = in.ok ? in.raw(dictionarySize) : nullptr;
+        if (!dictionary) return false;
+        restored.compressor.setDictionary(std::string(reinterpret_cast<const char*>(dictionary), dictionarySize));
+
+        if (!readStore(in, restored.localMessages) || !readStore(in, restored.remoteMessages) ||
+            !readTombstones(in, restored.localTombstones) || !readTombstones(in, restored.remoteTombstones)) {
+            return false;
+        }
+
+        uint64_t logSize = in.varint();
+        if (!in.ok || logSize > in.remaining()) return false;
+        restored.opLog.reserve(logSize);
+        uint64_t seq = 0;
+        for (uint64_t i = 0; i < logSize && in.ok; i++) {
+            seq += in.varint();
+            int id = static_cast<int>(in.svarint());
+            restored.opLog.push_back({seq, id, in.u8()});
+        }
+
+        if (!readVector(in, restored.versionVector)) return false;
+        uint64_t peerCount = in.varint();
+        for (uint64_t i = 0; i < peerCount && in.ok; i++) {
+            PeerState& peer = restored.peers[static_cast<uint32_t>(in.varint())];
+            peer.ackedCursor = in.varint();
+            peer.peerCursor = in.varint();
+            readVector(in, peer.seen);
+        }
+
+        uint64_t priorityCount = in.varint();
+        for (uint64_t i = 0; i < priorityCount && in.ok; i++) {
+            int conversation = static_cast<int>(in.svarint());
+            restored.conversationPriorities[conversation] = static_cast<int>(in.svarint());
+        }
+
+        uint64_t documentCount = in.varint();
+        for (uint64_t i = 0; i < documentCount && in.ok; i++) {
+            int docId = static_cast<int>(in.svarint());
+            uint64_t length = in.varint();
+            const uint8_t* update = in.ok ? in.raw(length) : nullptr;
+            if (!update) return false;
+            SyncUtils::ByteReader updateIn(update, length);
+            if (!restored.document(docId).applyUpdate(updateIn)) return false;
+        }
+        if (!in.ok || !in.atEnd()) return false;
+
+        restored.treeStale = true;
+        restored.recountAll();
+        // Settings and buffers that are not part of the snapshot carry over
+        std::swap(restored.coalescer, coalescer);
+        *this = std::move(restored);
+        return true;
+    }
 
+#ifdef __EMSCRIPTEN__
     /**
      * Get sync statistics
      */
@@ -230,19 +4015,20 @@ public:
         stats.set("localCount", (int)localMessages.size());
         stats.set("remoteCount", (int)remoteMessages.size());
 
-        int conflicts = 0;
-        for (const auto& pair : localMessages) {
-            int id = pair.first;
-            auto remoteIt = remoteMessages.find(id);
-            if (remoteIt != remoteMessages.end() &&
-                pair.second.hash != remoteIt->second.hash) {
-                conflicts++;
-            }
-        }
-        stats.set("conflicts", conflicts);
+        stats.set("conflicts", (int)conflictCount);
+        stats.set("added", (int)addedCount);
+        stats.set("deleted", (int)deletedCount);
+        stats.set("localOnly", (int)localOnlyCount);
+        stats.set("localDeleted", (int)localDeletedCount);
+        stats.set("tombstones", (int)localTombstones.size());
+        stats.set("remoteTombstones", (int)remoteTombstones.size());
+        stats.set("peers", (int)peers.size());
+        stats.set("pendingUpdates", (int)coalescer.size());
+        stats.set("coalescedUpdates", static_cast<double>(coalescer.supersededCount()));
 
         return stats;
     }
+#endif
 
     /**
      * Clear all data
@@ -250,18 +4036,230 @@ public:
     void clear() {
         localMessages.clear();
         remoteMessages.clear();
+        localTombstones.clear();
+        remoteTombstones.clear();
+        peers.clear();
+        versionVector.clear();
+        conversationPriorities.clear();
+        priorityVersion++;
+        coalescer.clear();
+        addedCount = 0;
+        deletedCount = 0;
+        conflictCount = 0;
+        localOnlyCount = 0;
+        localDeletedCount = 0;
+        diffCursor = DiffCursor();
+        localTree.clear();
+        localStrata.clear();
+        treeStale = false;
+        // Sequence numbers keep counting so stale cursors force a resync
+        opLog.clear();
+        documents.clear();
+        logFloor = nextSeq++;
+        pendingQueries.clear();
+        reconcileAdded.clear();
+        reconcileModified.clear();
+        reconcileDeleted.clear();
     }
 };
 
+// Native builds (bench/) compile the engine without the JS bindings
+#ifdef __EMSCRIPTEN__
+// Binary payloads cross into JS as a Uint8Array copy; inputs arrive as
+// Uint8Array/ArrayBuffer through std::string
+static val bytesToJS(const std::vector<uint8_t>& bytes) {
+    return val::global("Uint8Array").new_(typed_memory_view(bytes.size(), bytes.data()));
+}
+
+static val idsToJS(const std::vector<int>& ids) {
+    return val::global("Int32Array").new_(typed_memory_view(ids.size(), ids.data()));
+}
+
 EMSCRIPTEN_BINDINGS(sync_engine) {
+    constant("SYNC_SIDE_LOCAL", SyncEngine::SIDE_LOCAL);
+    constant("SYNC_SIDE_REMOTE", SyncEngine::SIDE_REMOTE);
+    constant("SYNC_DIFF_ADDED", SyncEngine::DIFF_ADDED);
+    constant("SYNC_DIFF_MODIFIED", SyncEngine::DIFF_MODIFIED);
+    constant("SYNC_DIFF_DELETED", SyncEngine::DIFF_DELETED);
+    constant("SYNC_DIFF_LOCAL_ONLY", SyncEngine::DIFF_LOCAL_ONLY);
+    constant("SYNC_DIFF_LOCAL_DELETED", SyncEngine::DIFF_LOCAL_DELETED);
+
     class_<SyncEngine>("SyncEngine")
         .constructor<>()
         .function("addLocalMessage", &SyncEngine::addLocalMessage)
         .function("addRemoteMessage", &SyncEngine::addRemoteMessage)
-        .function("calculateDiff", &SyncEngine::calculateDiff)
-        .function("generateDelta", &SyncEngine::generateDelta)
+        .function("loadBatch", &SyncEngine::loadBatch)
+        .function("loadCompressedBatch", &SyncEngine::loadCompressedBatch)
+        .function("trainDictionary", optional_override([](SyncEngine& self, unsigned int maxBytes) {
+            std::string dictionary = self.trainDictionary(maxBytes);
+            return val::global("Uint8Array").new_(typed_memory_view(dictionary.size(),
+                reinterpret_cast<const uint8_t*>(dictionary.data())));
+        }))
+        .function("setDictionary", &SyncEngine::setDictionary)
+        .function("setCompression", &SyncEngine::setCompression)
+        .function("compressPayload", optional_override([](SyncEngine& self, const std::string& buffer) {
+            return bytesToJS(self.compressPayload(buffer));
+        }))
+        .function("calculateDiff", optional_override([](SyncEngine& self) {
+            static const char* const names[5] = {"added", "modified", "deleted", "localOnly", "localDeleted"};
+            SyncEngine::DiffLists lists = self.calculateDiff();
+            val result = val::object();
+            for (int kind = 0; kind < 5; kind++) {
+                result.set(names[kind], val::array(lists[kind].begin(), lists[kind].end()));
+            }
+            return result;
+        }))
+        .function("beginDiff", &SyncEngine::beginDiff)
+        .function("nextDiffChunk", &SyncEngine::nextDiffChunk)
+        // Zero-copy Int32Array of (kind, id) pairs over the reusable chunk
+        // buffer; valid until the next nextDiffChunk() or heap growth
+        .function("getDiffChunkView", optional_override([](SyncEngine& self) {
+            const std::vector<int32_t>& chunk = self.diffChunk();
+            return val(typed_memory_view(chunk.size(), chunk.data()));
+        }))
+        .function("generateDelta", optional_override([](SyncEngine& self, int id) {
+            return bytesToJS(self.generateDelta(id));
+        }))
         .function("applyDelta", &SyncEngine::applyDelta)
+        .function("deleteLocalMessage", &SyncEngine::deleteLocalMessage)
+        .function("addRemoteTombstone", &SyncEngine::addRemoteTombstone)
+        .function("registerPeer", &SyncEngine::registerPeer)
+        .function("forgetPeer", &SyncEngine::forgetPeer)
+        .function("acknowledgePeer", optional_override([](SyncEngine& self, uint32_t peerId, double cursor) {
+            self.acknowledgePeer(peerId, cursor < 0 ? 0 : static_cast<uint64_t>(cursor));
+        }))
+        .function("collectTombstones", &SyncEngine::collectTombstones)
+        .function("setConversation", &SyncEngine::setConversation)
+        .function("setCoalesceWindow", &SyncEngine::setCoalesceWindow)
+        .function("queueUpdate", &SyncEngine::queueUpdate)
+        .function("updatesDue", &SyncEngine::updatesDue)
+        .function("flushUpdates", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.flushUpdates());
+        }))
+        .function("decodeUpdates", optional_override([](SyncEngine& self, const std::string& buffer) {
+            std::vector<UpdateCoalescer::Update> updates;
+            if (!self.decodeUpdates(buffer, updates)) return val::null();
+            val result = val::array();
+            for (size_t i = 0; i < updates.size(); i++) {
+                val update = val::object();
+                update.set("entity", updates[i].entity);
+                update.set("field", updates[i].field);
+                update.set("time", static_cast<double>(updates[i].time));
+                update.set("value", updates[i].value);
+                result.set(i, update);
+            }
+            return result;
+        }))
+        .function("setConversationPriority", &SyncEngine::setConversationPriority)
+        .function("beginPrioritySync", &SyncEngine::beginPrioritySync)
+        .function("nextSyncBatch", optional_override([](SyncEngine& self, uint32_t peerId,
+                                                        unsigned int maxBytes, double maxMillis) {
+            return bytesToJS(self.nextSyncBatch(peerId, maxBytes, maxMillis));
+        }))
+        .function("encodeVersionVector", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.encodeVersionVector());
+        }))
+        .function("setPeerVersionVector", &SyncEngine::setPeerVersionVector)
+        .function("getPeerCursor", optional_override([](SyncEngine& self, uint32_t peerId) {
+            return static_cast<double>(self.getPeerCursor(peerId));
+        }))
+        .function("changesForPeer", optional_override([](SyncEngine& self, uint32_t peerId) {
+            return bytesToJS(self.changesForPeer(peerId));
+        }))
+        .function("applyPeerChanges", optional_override([](SyncEngine& self, uint32_t peerId, const std::string& buffer) {
+            bool fullResync = false;
+            int applied = self.applyPeerChanges(peerId, buffer, fullResync);
+            val result = val::object();
+            result.set("applied", applied);
+            result.set("cursor", static_cast<double>(self.getPeerCursor(peerId)));
+            result.set("fullResync", fullResync);
+            return result;
+        }))
+        .function("getCursor", optional_override([](SyncEngine& self) {
+            return static_cast<double>(self.getCursor());
+        }))
+        .function("changesSince", optional_override([](SyncEngine& self, double cursor) {
+            return bytesToJS(self.changesSince(cursor < 0 ? 0 : static_cast<uint64_t>(cursor)));
+        }))
+        .function("changesFor", optional_override([](SyncEngine& self, val ids) {
+            return bytesToJS(self.changesFor(vecFromJSArray<int>(ids)));
+        }))
+        .function("applyChanges", optional_override([](SyncEngine& self, const std::string& buffer) {
+            uint64_t cursor = 0;
+            bool fullResync = false;
+            int applied = self.applyChanges(buffer, cursor, fullResync);
+            val result = val::object();
+            result.set("applied", applied);
+            result.set("cursor", static_cast<double>(cursor));
+            result.set("fullResync", fullResync);
+            return result;
+        }))
+        .function("generateAllDeltas", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.generateAllDeltas());
+        }))
+        .function("applyDeltaBatch", optional_override([](SyncEngine& self, const std::string& buffer) {
+            std::vector<int> failed;
+            int applied = self.applyDeltaBatch(buffer, failed);
+            val result = val::object();
+            result.set("applied", applied);
+            result.set("failed", val::array(failed.begin(), failed.end()));
+            return result;
+        }))
         .function("resolveConflict", &SyncEngine::resolveConflict)
+        .function("resolveAll", optional_override([](SyncEngine& self, bool apply) {
+            std::vector<int> ids;
+            std::vector<uint8_t> winners;
+            self.resolveAll(apply, ids, winners);
+            val result = val::object();
+            result.set("ids", idsToJS(ids));
+            result.set("winners", bytesToJS(winners));
+            return result;
+        }))
+        .function("setNodeId", &SyncEngine::setNodeId)
+        .function("textInsert", &SyncEngine::textInsert)
+        .function("textDelete", &SyncEngine::textDelete)
+        .function("getText", &SyncEngine::getText)
+        .function("getTextLength", &SyncEngine::getTextLength)
+        .function("getTextPendingCount", &SyncEngine::getTextPendingCount)
+        .function("encodeTextStateVector", optional_override([](SyncEngine& self, int docId) {
+            return bytesToJS(self.encodeTextStateVector(docId));
+        }))
+        .function("encodeTextUpdate", optional_override([](SyncEngine& self, int docId, const std::string& stateVector) {
+            return bytesToJS(self.encodeTextUpdate(docId, stateVector));
+        }))
+        .function("applyTextUpdate", &SyncEngine::applyTextUpdate)
         .function("getStats", &SyncEngine::getStats)
+        .function("beginReconcile", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.beginReconcile());
+        }))
+        .function("answerRangeQuery", optional_override([](SyncEngine& self, const std::string& request) {
+            return bytesToJS(self.answerRangeQuery(request));
+        }))
+        .function("continueReconcile", optional_override([](SyncEngine& self, const std::string& reply) {
+            return bytesToJS(self.continueReconcile(reply));
+        }))
+        .function("encodeStrataEstimator", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.encodeStrataEstimator());
+        }))
+        .function("encodeIBLTForPeer", optional_override([](SyncEngine& self, const std::string& estimator) {
+            return bytesToJS(self.encodeIBLTForPeer(estimator));
+        }))
+        .function("decodePeerIBLT", optional_override([](SyncEngine& self, const std::string& table) {
+            return bytesToJS(self.decodePeerIBLT(table));
+        }))
+        .function("getReconcileResult", optional_override([](SyncEngine& self) {
+            val result = val::object();
+            result.set("added", val::array(self.reconciledAdded().begin(), self.reconciledAdded().end()));
+            result.set("modified", val::array(self.reconciledModified().begin(), self.reconciledModified().end()));
+            result.set("deleted", val::array(self.reconciledDeleted().begin(), self.reconciledDeleted().end()));
+            result.set("complete", self.reconcileComplete());
+            return result;
+        }))
+        .function("getRangeHash", &SyncEngine::getRangeHash)
+        .function("serialize", optional_override([](SyncEngine& self) {
+            return bytesToJS(self.serialize());
+        }))
+        .function("deserialize", &SyncEngine::deserialize)
         .function("clear", &SyncEngine::clear);
 }
+#endif
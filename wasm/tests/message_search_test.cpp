@@ -0,0 +1,121 @@
+/**
+ * Native regression tests for the message and contact search engines
+ *
+ * Usage: message_search_test (exits non-zero if any check fails)
+ */
+
+#include "../message_search.cpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,        \
+                         __LINE__, #condition);                                \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+bool contains(const std::vector<int>& ids, int id) {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+void testRankedSearchSeesMessagesIndexedLater() {
+    MessageSearchEngine engine;
+    engine.indexMessage(1, "Lunch at noon?", "alice", "1700000000000");
+    engine.indexMessage(2, "The build is green", "bob", "1700000001000");
+    CHECK(engine.rankedSearch("lunch", 10) == std::vector<int>{1});
+
+    engine.indexMessage(3, "LUNCH lunch, lunch!", "carol", "1700000002000");
+    CHECK(engine.rankedSearch("lunch", 10) == (std::vector<int>{3, 1}));
+    CHECK(engine.rankedSearch("green", 10) == std::vector<int>{2});
+}
+
+void testSuggestionsCoverTermsIndexedLater() {
+    MessageSearchEngine engine;
+    engine.indexMessage(1, "meeting moved to thursday", "alice", "1700000000000");
+    std::string suggestion;
+    CHECK(engine.searchWithSuggestion("thrusday", suggestion).empty());
+    CHECK(suggestion == "thursday");
+
+    // Terms first seen after the previous lookup are suggested too
+    engine.indexMessage(2, "restaurant booked for the evening", "bob", "1700000001000");
+    CHECK(engine.searchWithSuggestion("restuarant", suggestion).empty());
+    CHECK(suggestion == "restaurant");
+    CHECK(engine.suggestCorrection("evning booked") == "evening booked");
+    CHECK(engine.suggestCorrection("thursday").empty());
+    CHECK(engine.suggestCorrection("qqqqqqqq").empty());
+
+    engine.clear();
+    CHECK(engine.suggestCorrection("thrusday").empty());
+}
+
+void testForwardedCopyIsNearDuplicate() {
+    MessageSearchEngine engine;
+    engine.indexMessage(1, "are we still on for lunch tomorrow?", "alice", "1700000000000");
+    engine.indexMessage(2, "FWD: are we still on for lunch tomorrow?", "bob", "1700000001000");
+    engine.indexMessage(3, "Fw: see you at 5", "carol", "1700000002000");
+    engine.indexMessage(4, "see you at 5", "dave", "1700000003000");
+    engine.indexMessage(5, "the build is broken again on main", "erin", "1700000004000");
+
+    CHECK(contains(engine.findNearDuplicates(1), 2));
+    CHECK(contains(engine.findNearDuplicates(4), 3));
+    CHECK(!contains(engine.findNearDuplicates(1), 5));
+}
+
+void testSpamWithRotatedLinkIsNearDuplicate() {
+    MessageSearchEngine engine;
+    engine.indexMessage(1, "Win a free iPhone now! Claim at https://bit.ly/3xYz9 before midnight", "spam1", "1700000000000");
+    engine.indexMessage(2, "Win a free iPhone now! Claim at https://tinyurl.com/qq81k before midnight", "spam2", "1700000001000");
+    engine.indexMessage(3, "https://youtube.com/watch?v=abc", "alice", "1700000002000");
+    engine.indexMessage(4, "https://example.org/news/today", "bob", "1700000003000");
+
+    CHECK(contains(engine.findNearDuplicates(1), 2));
+    CHECK(!contains(engine.findNearDuplicates(3), 4));
+}
+
+void testContactSearchOnEmptyEngine() {
+    ContactSearchEngine engine;
+    CHECK(engine.search("ann", 10).empty());
+    CHECK(engine.getContactCount() == 0);
+}
+
+void testContactSearchAfterClear() {
+    ContactSearchEngine engine;
+    engine.addContact(1, "Ann Lee", "annlee");
+    engine.addContact(2, "Bob Stone", "bstone");
+    CHECK(engine.search("ann", 10) == std::vector<int>{1});
+
+    engine.clear();
+    CHECK(engine.search("ann", 10).empty());
+    CHECK(engine.search("b", 10).empty());
+    CHECK(engine.getContactCount() == 0);
+
+    engine.addContact(3, "Annika Berg", "aberg");
+    CHECK(engine.search("ann", 10) == std::vector<int>{3});
+}
+
+} // namespace
+
+int main() {
+    testRankedSearchSeesMessagesIndexedLater();
+    testSuggestionsCoverTermsIndexedLater();
+    testForwardedCopyIsNearDuplicate();
+    testSpamWithRotatedLinkIsNearDuplicate();
+    testContactSearchOnEmptyEngine();
+    testContactSearchAfterClear();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("message_search_test: all checks passed\n");
+    return EXIT_SUCCESS;
+}
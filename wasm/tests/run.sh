@@ -0,0 +1,38 @@
+#!/bin/bash
+# Build and run native regression tests for the WebAssembly modules
+# Uses the host C++ compiler; Emscripten is not required
+
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+OUT_DIR=build
+TESTS="message_search_test sync_engine_test"
+
+echo "🧪 Building native tests with $CXX..."
+
+if ! command -v "$CXX" &> /dev/null; then
+    echo "❌ Error: C++ compiler ($CXX) not found!"
+    echo "Set CXX to a C++17 compiler, e.g. CXX=clang++ ./run.sh"
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+for test in $TESTS; do
+    "$CXX" "$test.cpp" \
+        -o "$OUT_DIR/$test" \
+        -O1 \
+        -g \
+        -std=c++17
+
+    if [ $? -ne 0 ]; then
+        echo "❌ Build failed: $test"
+        exit 1
+    fi
+
+    if ! "$OUT_DIR/$test"; then
+        echo "❌ Failed: $test"
+        exit 1
+    fi
+    echo "✅ $test"
+done
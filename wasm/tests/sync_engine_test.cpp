@@ -0,0 +1,535 @@
+/**
+ * Native regression tests for the sync engine
+ *
+ * Usage: sync_engine_test (exits non-zero if any check fails)
+ */
+
+#include "../sync_engine.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,        \
+                         __LINE__, #condition);                                \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+const long long BASE_TIME = 1700000000000LL;
+
+std::string asString(const std::vector<uint8_t>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+void fill(SyncEngine& engine, int count) {
+    for (int i = 0; i < count; i++) {
+        engine.addLocalMessage(i, "message " + std::to_string(i), BASE_TIME + i * 1000LL);
+    }
+}
+
+// Same tag as a real estimator, but no stratum decodes, so the raw
+// estimate is 2^STRATA
+std::string corruptEstimator(uint8_t tag) {
+    const size_t cells = InvertibleBloomTable(StrataEstimator::CELLS_PER_STRATUM).size();
+    SyncUtils::ByteWriter out;
+    out.u8(tag);
+    for (int s = 0; s < StrataEstimator::STRATA; s++) {
+        for (size_t c = 0; c < cells; c++) {
+            out.svarint(2);
+            out.u32(0x9E3779B9u * static_cast<uint32_t>(s * cells + c + 1));
+            out.u64(0xDEADBEEFCAFEF00DULL);
+            out.u32(0x12345678u);
+        }
+    }
+    return asString(out.bytes);
+}
+
+// loadBatch() layout: u32 count, (i32 id, i64 timestamp, u32 offset,
+// u32 length) records, content arena
+std::string packBatch(const std::vector<std::pair<int, std::pair<long long, std::string>>>& messages) {
+    std::string header, arena;
+    auto put = [&](uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) header += static_cast<char>((value >> (8 * i)) & 0xFF);
+    };
+    put(messages.size(), 4);
+    for (const auto& entry : messages) {
+        put(static_cast<uint32_t>(entry.first), 4);
+        put(static_cast<uint64_t>(entry.second.first), 8);
+        put(arena.size(), 4);
+        put(entry.second.second.size(), 4);
+        arena += entry.second.second;
+    }
+    return header + arena;
+}
+
+// Remote IDs that resolveAll() picks over the local copy
+std::vector<int> remoteWinners(SyncEngine& engine) {
+    std::vector<int> ids, won;
+    std::vector<uint8_t> winners;
+    engine.resolveAll(false, ids, winners);
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (winners[i >> 3] & (1u << (i & 7))) won.push_back(ids[i]);
+    }
+    return won;
+}
+
+// encodeVersionVector() in a comparable form
+std::map<uint32_t, uint64_t> versionVector(const SyncEngine& engine) {
+    std::vector<uint8_t> bytes = engine.encodeVersionVector();
+    SyncUtils::ByteReader in(bytes.data(), bytes.size());
+    in.u8();
+    std::map<uint32_t, uint64_t> vector;
+    for (uint64_t i = 0, n = in.varint(); i < n && in.ok; i++) {
+        uint32_t origin = static_cast<uint32_t>(in.varint());
+        vector[origin] = in.varint();
+    }
+    return vector;
+}
+
+// Run Merkle reconciliation to the end; see initiator.reconciled*()
+void reconcile(SyncEngine& initiator, SyncEngine& peer) {
+    std::vector<uint8_t> query = initiator.beginReconcile();
+    for (int rounds = 0; !query.empty() && rounds < 64; rounds++) {
+        query = initiator.continueReconcile(asString(peer.answerRangeQuery(asString(query))));
+    }
+    CHECK(initiator.reconcileComplete());
+}
+
+bool nothingReconciled(const SyncEngine& engine) {
+    return engine.reconciledAdded().empty() && engine.reconciledModified().empty() &&
+           engine.reconciledDeleted().empty();
+}
+
+// Touches every part of the snapshot: both stores, both tombstone sets,
+// the op log, a peer with a cursor and a version vector, a conversation
+// priority, text documents and a dictionary
+const uint32_t SNAPSHOT_PEER = 5;
+
+void buildSnapshotSource(SyncEngine& engine) {
+    engine.setNodeId(3);
+    fill(engine, 60);
+    for (int i = 40; i < 70; i++) {
+        engine.addRemoteMessage(i, "remote " + std::to_string(i % 7), BASE_TIME + i * 1500LL);
+    }
+    engine.deleteLocalMessage(5, BASE_TIME + 90000);
+    engine.deleteLocalMessage(6, BASE_TIME + 91000);
+    engine.addRemoteTombstone(45, BASE_TIME + 95000);
+    engine.setConversation(10, 2);
+    engine.setConversation(11, 2);
+    engine.setConversationPriority(2, 5);
+
+    SyncEngine peer;
+    peer.setNodeId(SNAPSHOT_PEER);
+    peer.addLocalMessage(900, "from the peer", BASE_TIME + 120000);
+    engine.registerPeer(SNAPSHOT_PEER);
+    engine.acknowledgePeer(SNAPSHOT_PEER, engine.getCursor() - 3);
+    bool fullResync = false;
+    CHECK(engine.applyPeerChanges(SNAPSHOT_PEER, asString(peer.changesSince(0)), fullResync) == 1);
+    CHECK(engine.setPeerVersionVector(SNAPSHOT_PEER, asString(peer.encodeVersionVector())));
+
+    engine.textInsert(1, 0, "hello world");
+    engine.textInsert(1, 5, ",");
+    engine.textDelete(1, 0, 1);
+    engine.textInsert(2, 0, "second document");
+    engine.trainDictionary(4096);
+}
+
+bool compressRoundTrips(BlockCompressor& compressor, const std::string& text) {
+    std::vector<uint8_t> block;
+    compressor.compress(reinterpret_cast<const uint8_t*>(text.data()), text.size(), block);
+    std::string rebuilt;
+    return compressor.decompress(block.data(), block.size(), text.size(), rebuilt) && rebuilt == text;
+}
+
+size_t compressedSize(BlockCompressor& compressor, const std::string& text) {
+    std::vector<uint8_t> block;
+    compressor.compress(reinterpret_cast<const uint8_t*>(text.data()), text.size(), block);
+    return block.size();
+}
+
+std::vector<uint8_t> encodeDelta(const std::string& oldText, const std::string& newText) {
+    DeltaCodec codec;
+    SyncUtils::ByteWriter out;
+    codec.encode(oldText, newText, out);
+    return out.bytes;
+}
+
+bool deltaRoundTrips(const std::string& oldText, const std::string& newText) {
+    std::vector<uint8_t> delta = encodeDelta(oldText, newText);
+    std::string rebuilt = "stale";
+    return DeltaCodec::apply(oldText, delta.data(), delta.size(), rebuilt) && rebuilt == newText;
+}
+
+void testCompressRoundTrip() {
+    const std::string chat = "See you at the station at nine, bring the tickets and the map please!";
+    std::vector<std::string> inputs = {"", "a", "abc", "abcd", chat, chat + chat + chat, std::string(1000, 'x'),
+                                       std::string("a\0b\xff\0\0\0\0a\0b\xff", 12)};
+    std::mt19937 rng(11);
+    std::string noise, words, large;
+    for (int i = 0; i < 5000; i++) noise += static_cast<char>(rng());
+    for (int i = 0; i < 3000; i++) words += "ab cd ef gh "[rng() % 12];
+    // Longer than the 64 KB match window
+    while (large.size() < 150000) large += chat.substr(rng() % 20, 20 + rng() % 40) + std::to_string(rng() % 1000);
+    inputs.insert(inputs.end(), {noise, words, large});
+
+    BlockCompressor plain;
+    for (const std::string& text : inputs) CHECK(compressRoundTrips(plain, text));
+
+    BlockCompressor primed;
+    const std::string dictionary = "tickets and the map please! See you at the station at ";
+    primed.setDictionary(dictionary);
+    for (const std::string& text : inputs) CHECK(compressRoundTrips(primed, text));
+    // Matches that begin in the dictionary and run on into the block
+    CHECK(compressRoundTrips(primed, dictionary.substr(dictionary.size() - 6) + dictionary + "xyz"));
+    CHECK(compressRoundTrips(primed, dictionary.substr(dictionary.size() - 2) + "at at at at at"));
+    CHECK(compressedSize(primed, chat) < compressedSize(plain, chat) / 2);
+
+    // Each block sees only the dictionary, never an earlier block
+    for (BlockCompressor* compressor : {&plain, &primed}) {
+        const size_t fresh = compressedSize(*compressor, chat);
+        CHECK(compressRoundTrips(*compressor, chat + " once more"));
+        CHECK(compressedSize(*compressor, chat) == fresh);
+    }
+
+    // A block compressed against one dictionary does not decode without it
+    std::vector<uint8_t> block;
+    primed.compress(reinterpret_cast<const uint8_t*>(chat.data()), chat.size(), block);
+    std::string out;
+    CHECK(!plain.decompress(block.data(), block.size(), chat.size(), out));
+}
+
+void testDeltaRoundTrip() {
+    const std::string base = "The quick brown fox jumps over the lazy dog, then naps in the afternoon sun.";
+    CHECK(deltaRoundTrips(base, "Oh! " + base));
+    CHECK(deltaRoundTrips(base, base + " Twice."));
+    CHECK(deltaRoundTrips(base, "So, t" + base.substr(1, base.size() - 2) + "!"));
+    CHECK(deltaRoundTrips(base, base.substr(10)));
+    CHECK(deltaRoundTrips(base, base.substr(0, 20)));
+    CHECK(deltaRoundTrips(base, base.substr(40) + base.substr(0, 40)));
+    CHECK(deltaRoundTrips(base, "completely different text of similar length, nothing shared at all"));
+    CHECK(deltaRoundTrips("", base));
+    CHECK(deltaRoundTrips(base, ""));
+    CHECK(deltaRoundTrips("", ""));
+    CHECK(deltaRoundTrips(std::string("a\0b\xff", 4), std::string("a\0c\xff\0", 5)));
+
+    // Identical input is a header plus a single COPY
+    std::vector<uint8_t> same = encodeDelta(base, base);
+    CHECK(deltaRoundTrips(base, base));
+    CHECK(same.size() <= 6);
+
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200; round++) {
+        std::string oldText, newText;
+        for (int i = 0, n = rng() % 300; i < n; i++) oldText += static_cast<char>('a' + rng() % 4);
+        newText = oldText;
+        for (int edits = rng() % 5; edits > 0; edits--) {
+            size_t pos = newText.empty() ? 0 : rng() % newText.size();
+            if (rng() % 2) newText.insert(pos, std::string(rng() % 20, static_cast<char>('e' + rng() % 3)));
+            else newText.erase(pos, rng() % 20);
+        }
+        CHECK(deltaRoundTrips(oldText, newText));
+    }
+}
+
+void testDeltaRejectsMalformedInput() {
+    const std::string base = "Meet at the station at nine, platform four, bring the tickets.";
+    const std::string edited = "Meet at the old station at ten, platform four, bring both tickets!";
+    std::vector<uint8_t> delta = encodeDelta(base, edited);
+    std::string out;
+
+    CHECK(!DeltaCodec::apply(base, delta.data(), 0, out));
+    for (size_t length = 1; length < delta.size(); length++) {
+        CHECK(!DeltaCodec::apply(base, delta.data(), length, out));
+    }
+
+    std::vector<uint8_t> badVersion = delta;
+    badVersion[0] = DeltaCodec::VERSION + 1;
+    CHECK(!DeltaCodec::apply(base, badVersion.data(), badVersion.size(), out));
+
+    // COPY past the end of the base, and one before its start
+    SyncUtils::ByteWriter pastEnd;
+    pastEnd.u8(DeltaCodec::VERSION);
+    pastEnd.varint(10);
+    pastEnd.varint(10 << 1);
+    pastEnd.svarint(static_cast<int64_t>(base.size()) - 5);
+    CHECK(!DeltaCodec::apply(base, pastEnd.bytes.data(), pastEnd.bytes.size(), out));
+
+    SyncUtils::ByteWriter beforeStart;
+    beforeStart.u8(DeltaCodec::VERSION);
+    beforeStart.varint(4);
+    beforeStart.varint(4 << 1);
+    beforeStart.svarint(-1);
+    CHECK(!DeltaCodec::apply(base, beforeStart.bytes.data(), beforeStart.bytes.size(), out));
+
+    // Ops producing more than the declared length, and an absurd length
+    SyncUtils::ByteWriter overrun;
+    overrun.u8(DeltaCodec::VERSION);
+    overrun.varint(2);
+    overrun.varint((3 << 1) | 1);
+    overrun.raw(reinterpret_cast<const uint8_t*>("abc"), 3);
+    CHECK(!DeltaCodec::apply(base, overrun.bytes.data(), overrun.bytes.size(), out));
+
+    SyncUtils::ByteWriter huge;
+    huge.u8(DeltaCodec::VERSION);
+    huge.varint(uint64_t(1) << 40);
+    huge.varint(uint64_t(1) << 41);
+    huge.svarint(0);
+    CHECK(!DeltaCodec::apply(base, huge.bytes.data(), huge.bytes.size(), out));
+
+    // Flipped bytes must never read outside the buffers; ASan builds check
+    for (size_t i = 1; i < delta.size(); i++) {
+        std::vector<uint8_t> corrupt = delta;
+        corrupt[i] ^= 0x5A;
+        DeltaCodec::apply(base, corrupt.data(), corrupt.size(), out);
+    }
+}
+
+void testHistoryLoadOrderDoesNotChangeWinner() {
+    for (bool newestFirst : {false, true}) {
+        SyncEngine engine;
+        engine.setNodeId(1);
+        if (newestFirst) {
+            engine.addLocalMessage(2, "later message", BASE_TIME + 60000);
+            engine.addLocalMessage(1, "original", BASE_TIME);
+        } else {
+            engine.addLocalMessage(1, "original", BASE_TIME);
+            engine.addLocalMessage(2, "later message", BASE_TIME + 60000);
+        }
+        engine.addRemoteMessage(1, "edited remotely", BASE_TIME + 30000);
+        CHECK(remoteWinners(engine) == std::vector<int>{1});
+    }
+
+    for (bool newestFirst : {false, true}) {
+        std::vector<std::pair<int, std::pair<long long, std::string>>> history = {
+            {1, {BASE_TIME, "original"}}, {2, {BASE_TIME + 60000, "later message"}}};
+        if (newestFirst) std::swap(history[0], history[1]);
+        SyncEngine engine;
+        engine.setNodeId(1);
+        CHECK(engine.loadBatch(SyncEngine::SIDE_LOCAL, packBatch(history)) == 2);
+        engine.addRemoteMessage(1, "edited remotely", BASE_TIME + 30000);
+        CHECK(remoteWinners(engine) == std::vector<int>{1});
+    }
+}
+
+void testLocalEditStillTicksPastHistory() {
+    SyncEngine engine;
+    engine.setNodeId(1);
+    engine.addLocalMessage(2, "later message", BASE_TIME + 60000);
+    engine.addLocalMessage(1, "original", BASE_TIME);
+    engine.addRemoteMessage(1, "edited remotely", BASE_TIME + 30000);
+
+    // An edit made after seeing T+60s wins even if the wall clock lags
+    engine.addLocalMessage(1, "edited locally", BASE_TIME + 10000);
+    CHECK(remoteWinners(engine).empty());
+}
+
+void testImportedHistoryIsNotCoveredByVersionVectors() {
+    SyncEngine sender, other;
+    sender.setNodeId(1);
+    other.setNodeId(2);
+    sender.loadBatch(SyncEngine::SIDE_LOCAL, packBatch({{1, {BASE_TIME, "ours"}}}));
+    other.loadBatch(SyncEngine::SIDE_LOCAL, packBatch({{7, {BASE_TIME + 60000, "theirs"}}}));
+
+    // The peer's own import says nothing about ours
+    sender.registerPeer(2);
+    CHECK(sender.setPeerVersionVector(2, asString(other.encodeVersionVector())));
+    bool fullResync = false;
+    CHECK(other.applyPeerChanges(1, asString(sender.changesForPeer(2)), fullResync) == -1);
+    other.registerPeer(1);
+    CHECK(other.applyPeerChanges(1, asString(sender.changesForPeer(2)), fullResync) == 1);
+}
+
+void testSnapshotRoundTrip() {
+    SyncEngine source;
+    buildSnapshotSource(source);
+    std::vector<uint8_t> snapshot = source.serialize();
+    SyncEngine restored;
+    fill(restored, 3);
+    CHECK(restored.deserialize(asString(snapshot)));
+
+    // Stores, tombstones and stamps
+    CHECK(restored.calculateDiff() == source.calculateDiff());
+    CHECK(remoteWinners(restored) == remoteWinners(source));
+
+    // Op log and cursor
+    CHECK(restored.getCursor() == source.getCursor());
+    CHECK(restored.changesSince(0) == source.changesSince(0));
+    CHECK(restored.changesSince(source.getCursor() - 4) == source.changesSince(source.getCursor() - 4));
+
+    // Peers and priorities
+    CHECK(versionVector(restored) == versionVector(source));
+    CHECK(restored.getPeerCursor(SNAPSHOT_PEER) == source.getPeerCursor(SNAPSHOT_PEER));
+    CHECK(restored.changesForPeer(SNAPSHOT_PEER) == source.changesForPeer(SNAPSHOT_PEER));
+    CHECK(restored.beginPrioritySync(SNAPSHOT_PEER) == source.beginPrioritySync(SNAPSHOT_PEER));
+    CHECK(restored.nextSyncBatch(SNAPSHOT_PEER, 0, 0) == source.nextSyncBatch(SNAPSHOT_PEER, 0, 0));
+
+    // Documents keep their item IDs, so edits still merge
+    CHECK(restored.getText(1) == "ello, world");
+    CHECK(restored.getText(2) == source.getText(2));
+    restored.textInsert(1, 4, "!");
+    CHECK(source.applyTextUpdate(1, asString(restored.encodeTextUpdate(1, asString(source.encodeTextStateVector(1))))));
+    CHECK(source.getText(1) == restored.getText(1));
+
+    // Clock, node ID and sequence numbers carry on where they left off
+    const uint64_t cursor = source.getCursor();
+    source.addLocalMessage(7, "edited after restoring", BASE_TIME);
+    restored.addLocalMessage(7, "edited after restoring", BASE_TIME);
+    CHECK(restored.getCursor() == source.getCursor());
+    CHECK(restored.changesSince(cursor) == source.changesSince(cursor));
+
+    CHECK(restored.collectTombstones() == source.collectTombstones());
+}
+
+void testSnapshotRejectsDamage() {
+    SyncEngine source;
+    buildSnapshotSource(source);
+    const std::string snapshot = asString(source.serialize());
+
+    SyncEngine engine;
+    fill(engine, 10);
+    const std::vector<uint8_t> before = engine.serialize();
+
+    std::string damaged = snapshot;
+    damaged[damaged.size() - 3] ^= 0x01;
+    CHECK(!engine.deserialize(damaged));
+    damaged = snapshot;
+    damaged[damaged.size() / 2] ^= 0x40;
+    CHECK(!engine.deserialize(damaged));
+    CHECK(!engine.deserialize(snapshot.substr(0, snapshot.size() - 1)));
+    CHECK(!engine.deserialize(""));
+
+    // A later layout, even with a valid checksum
+    damaged = snapshot.substr(0, snapshot.size() - 8);
+    damaged[1]++;
+    SyncUtils::ByteWriter checksum;
+    checksum.u64(SyncUtils::hash64(damaged.data(), damaged.size()));
+    CHECK(!engine.deserialize(damaged + asString(checksum.bytes)));
+
+    CHECK(engine.serialize() == before);
+}
+
+void testRestoredEngineReconcilesWithoutRehashing() {
+    SyncEngine source;
+    fill(source, 300);
+    source.deleteLocalMessage(17, BASE_TIME + 900000);
+    const std::vector<uint8_t> snapshot = source.serialize();
+
+    SyncEngine restored;
+    CHECK(restored.deserialize(asString(snapshot)));
+    reconcile(restored, source);
+    CHECK(nothingReconciled(restored));
+    reconcile(source, restored);
+    CHECK(nothingReconciled(source));
+    std::vector<uint8_t> table = source.encodeIBLTForPeer(asString(restored.encodeStrataEstimator()));
+    CHECK(restored.decodePeerIBLT(asString(table)).empty());
+    CHECK(nothingReconciled(restored));
+
+    // Rewrite the stored content hash of message 0 (and the checksum).
+    // The restored tree is built from stored hashes, so reconciliation
+    // now flags message 0, which it would not if content were rehashed.
+    SyncUtils::ByteReader in(snapshot.data(), snapshot.size() - 8);
+    in.u8();
+    in.u8();
+    for (int field = 0; field < 4; field++) in.varint();
+    in.u8();
+    in.raw(in.varint());
+    CHECK(in.varint() == 299);
+    CHECK(in.svarint() == 0);
+    in.svarint();
+    std::string tampered = asString(snapshot);
+    const size_t hashAt = snapshot.size() - 8 - in.remaining();
+    tampered[hashAt] ^= 0x01;
+    tampered.resize(tampered.size() - 8);
+    SyncUtils::ByteWriter checksum;
+    checksum.u64(SyncUtils::hash64(tampered.data(), tampered.size()));
+    tampered += asString(checksum.bytes);
+
+    SyncEngine stale;
+    CHECK(stale.deserialize(tampered));
+    reconcile(stale, source);
+    CHECK(stale.reconciledModified() == std::vector<int>{0});
+}
+
+void testIBLTRoundTrip() {
+    SyncEngine initiator, peer;
+    fill(initiator, 100);
+    fill(peer, 103);
+
+    std::vector<uint8_t> table = peer.encodeIBLTForPeer(asString(initiator.encodeStrataEstimator()));
+    CHECK(!table.empty());
+    CHECK(initiator.decodePeerIBLT(asString(table)).empty());
+    CHECK(initiator.reconciledAdded() == (std::vector<int>{100, 101, 102}));
+}
+
+void testCorruptEstimatorFallsBackToMerkle() {
+    SyncEngine initiator, peer;
+    fill(initiator, 100);
+    fill(peer, 103);
+
+    const uint8_t tag = initiator.encodeStrataEstimator().at(0);
+    std::vector<uint8_t> table = peer.encodeIBLTForPeer(corruptEstimator(tag));
+    CHECK(table.empty());
+
+    // The empty reply starts Merkle reconciliation on the initiator
+    std::vector<uint8_t> query = initiator.decodePeerIBLT(asString(table));
+    CHECK(!query.empty());
+    int rounds = 0;
+    while (!query.empty() && rounds++ < 64) {
+        query = initiator.continueReconcile(asString(peer.answerRangeQuery(asString(query))));
+    }
+    CHECK(initiator.reconcileComplete());
+    CHECK(initiator.reconciledAdded() == (std::vector<int>{100, 101, 102}));
+}
+
+void testUnknownPeerIsNotRegistered() {
+    SyncEngine engine;
+    fill(engine, 10);
+    engine.deleteLocalMessage(3, BASE_TIME + 60000);
+    engine.registerPeer(1);
+    engine.acknowledgePeer(1, engine.getCursor());
+
+    SyncEngine other;
+    fill(other, 12);
+    bool fullResync = false;
+    CHECK(engine.changesForPeer(7).empty());
+    CHECK(engine.applyPeerChanges(7, asString(other.changesSince(0)), fullResync) == -1);
+    CHECK(engine.beginPrioritySync(7) == 0);
+    CHECK(engine.nextSyncBatch(7, 0, 0).empty());
+    CHECK(!engine.setPeerVersionVector(7, asString(other.encodeVersionVector())));
+
+    // Peer 7 would hold the tombstone back if any call had registered it
+    CHECK(engine.collectTombstones() == 1);
+}
+
+} // namespace
+
+int main() {
+    testCompressRoundTrip();
+    testDeltaRoundTrip();
+    testDeltaRejectsMalformedInput();
+    testHistoryLoadOrderDoesNotChangeWinner();
+    testLocalEditStillTicksPastHistory();
+    testImportedHistoryIsNotCoveredByVersionVectors();
+    testSnapshotRoundTrip();
+    testSnapshotRejectsDamage();
+    testRestoredEngineReconcilesWithoutRehashing();
+    testIBLTRoundTrip();
+    testCorruptEstimatorFallsBackToMerkle();
+    testUnknownPeerIsNotRegistered();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("sync_engine_test: all checks passed\n");
+    return EXIT_SUCCESS;
+}